@@ -1,6 +1,7 @@
 #pragma once
 
 #include "daisy_patch_sm.h"
+#include "midi.h"
 
 namespace wreath
 {
@@ -20,6 +21,31 @@ namespace wreath
     Led led;
     Switch tap, toggle;
 
+    MidiUsbTransport midiUsb;
+    MidiParser midiParser;
+    MidiQueue midiQueue;
+
+    // Called by the USB interrupt with the raw MIDI bytes received.
+    void MidiRxCallback(uint8_t *data, size_t size, void *context)
+    {
+        MidiMessage message;
+        for (size_t i = 0; i < size; i++)
+        {
+            if (midiParser.Parse(data[i], message))
+            {
+                midiQueue.Push(message);
+            }
+        }
+    }
+
+    inline void InitMidi()
+    {
+        MidiUsbTransport::Config config;
+        config.periph = MidiUsbTransport::Config::INTERNAL;
+        midiUsb.Init(config);
+        midiUsb.StartRx(MidiRxCallback, nullptr);
+    }
+
     inline void InitHw()
     {
         hw.Init();
@@ -33,6 +59,12 @@ namespace wreath
             hw.controls[i].SetCoeff(1.f); // No slew;
             knobs[i].Init(hw.controls[i], 0.0f, 1.0f, Parameter::LINEAR);
         }
+
+#ifndef PROFILING_SERIAL
+        // The USB port is used for the profiler's output when profiling over
+        // serial.
+        InitMidi();
+#endif
     }
 
     inline void ProcessControls()
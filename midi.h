@@ -0,0 +1,368 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    // Maximum number of messages waiting to be applied, must be a power of 2.
+    constexpr size_t kMidiQueueSize{256};
+    // MIDI clock pulses per quarter note.
+    constexpr uint32_t kMidiClockPpqn{24};
+
+    // Status bytes.
+    constexpr uint8_t kMidiNoteOff{0x80};
+    constexpr uint8_t kMidiNoteOn{0x90};
+    constexpr uint8_t kMidiControlChange{0xB0};
+    constexpr uint8_t kMidiSysEx{0xF0};
+    constexpr uint8_t kMidiClock{0xF8};
+    constexpr uint8_t kMidiStart{0xFA};
+
+    // MIDI CCs, four consecutive numbers (Blend, Start, Tone, Size) for each
+    // channel, in the same order as the Channel enum: 20-23 left, 24-27 right,
+    // 28-31 both, 32-35 settings page.
+    constexpr uint8_t kMidiFirstParameterCc{20};
+    constexpr uint8_t kMidiParameterChannels{4};
+    constexpr uint8_t kMidiParametersPerChannel{4};
+    // Pitch shift, in the same order: 36 left, 37 right, 38 both.
+    constexpr uint8_t kMidiFirstPitchShiftCc{36};
+    // Spectral freeze, in the same order: 39 left, 40 right, 41 both.
+    constexpr uint8_t kMidiFirstSpectralFreezeCc{39};
+    constexpr uint8_t kMidiEffectChannels{3};
+    // Motion recording on (>= 64) and off, and motion clear (>= 64).
+    constexpr uint8_t kMidiMotionRecordCc{42};
+    constexpr uint8_t kMidiMotionClearCc{43};
+    // Recording threshold in REC mode, from -48dB to 0dB (0 disables it).
+    constexpr uint8_t kMidiOnsetThresholdCc{44};
+
+    struct MidiMessage
+    {
+        uint8_t status; // Channel messages keep the channel in the low nibble.
+        uint8_t data1;
+        uint8_t data2;
+
+        uint8_t Type() const { return status < kMidiSysEx ? status & 0xF0 : status; }
+        uint8_t GetChannel() const { return status & 0x0F; }
+    };
+
+    /**
+     * @brief Turns a raw MIDI byte stream into messages. Handles running status
+     * and real-time messages interleaved with other messages, and skips system
+     * exclusive and system common messages.
+     */
+    class MidiParser
+    {
+    public:
+        MidiParser() {}
+        ~MidiParser() {}
+
+        // Returns true when the byte completes a message.
+        bool Parse(uint8_t byte, MidiMessage &message)
+        {
+            // Real-time messages can appear anywhere, even inside other
+            // messages, and don't affect the running status.
+            if (byte >= kMidiClock)
+            {
+                message = {byte, 0, 0};
+
+                return true;
+            }
+
+            if (byte & 0x80)
+            {
+                // System common and exclusive messages cancel the running
+                // status and are ignored.
+                runningStatus_ = byte < kMidiSysEx ? byte : 0;
+                dataCount_ = 0;
+
+                return false;
+            }
+
+            if (!runningStatus_)
+            {
+                return false;
+            }
+
+            data_[dataCount_++] = byte;
+            uint8_t type = runningStatus_ & 0xF0;
+            // Program change and channel pressure only have one data byte.
+            size_t expected = (0xC0 == type || 0xD0 == type) ? 1 : 2;
+            if (dataCount_ < expected)
+            {
+                return false;
+            }
+            dataCount_ = 0;
+
+            message = {runningStatus_, data_[0], expected == 2 ? data_[1] : static_cast<uint8_t>(0)};
+            // A note on with no velocity is a note off.
+            if (kMidiNoteOn == type && 0 == message.data2)
+            {
+                message.status = kMidiNoteOff | message.GetChannel();
+            }
+
+            return true;
+        }
+
+    private:
+        uint8_t runningStatus_{};
+        uint8_t data_[2]{};
+        size_t dataCount_{};
+    };
+
+    /**
+     * @brief Preallocated single producer, single consumer queue, written by
+     * the USB receive interrupt and drained by the audio callback.
+     */
+    class MidiQueue
+    {
+    public:
+        MidiQueue() {}
+        ~MidiQueue() {}
+
+        bool Push(const MidiMessage &message)
+        {
+            size_t write = write_.load(std::memory_order_relaxed);
+            if (write - read_.load(std::memory_order_acquire) >= kMidiQueueSize)
+            {
+                overflows_++;
+
+                return false;
+            }
+            messages_[write & (kMidiQueueSize - 1)] = message;
+            write_.store(write + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool Pop(MidiMessage &message)
+        {
+            size_t read = read_.load(std::memory_order_relaxed);
+            if (read == write_.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            message = messages_[read & (kMidiQueueSize - 1)];
+            read_.store(read + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        uint32_t GetOverflows() { return overflows_; }
+
+    private:
+        MidiMessage messages_[kMidiQueueSize]{};
+        std::atomic<size_t> write_{};
+        std::atomic<size_t> read_{};
+        uint32_t overflows_{};
+    };
+
+    /**
+     * @brief Measures the tempo of an incoming MIDI clock in samples per beat.
+     * Pulses are timestamped with the block they're applied in, the error is
+     * averaged out over a beat.
+     */
+    class MidiClock
+    {
+    public:
+        MidiClock() {}
+        ~MidiClock() {}
+
+        void Reset()
+        {
+            Restart();
+            samplesPerBeat_ = 0.f;
+        }
+
+        // Restarts the measurement from the next pulse, like on a MIDI Start,
+        // keeping the tempo measured so far.
+        void Restart()
+        {
+            ticks_ = 0;
+            samples_ = 0;
+        }
+
+        // Returns true when a new beat has been measured.
+        bool Tick()
+        {
+            if (0 == ticks_)
+            {
+                samples_ = 0;
+            }
+            ticks_++;
+            if (ticks_ <= kMidiClockPpqn)
+            {
+                return false;
+            }
+            // Smooth the tempo to get rid of the jitter of the transport.
+            float measured = static_cast<float>(samples_);
+            samplesPerBeat_ = samplesPerBeat_ > 0.f ? samplesPerBeat_ + (measured - samplesPerBeat_) * 0.5f : measured;
+            ticks_ = 1;
+            samples_ = 0;
+
+            return true;
+        }
+
+        // Advances the clock of the given number of samples, once per block.
+        void Advance(size_t samples)
+        {
+            if (0 == ticks_ && !IsRunning())
+            {
+                return;
+            }
+            samples_ += samples;
+            // The clock is considered gone after a few beats without pulses.
+            if (samplesPerBeat_ > 0.f && samples_ > kMidiClockTimeoutBeats * samplesPerBeat_)
+            {
+                Reset();
+            }
+        }
+
+        bool IsRunning() { return samplesPerBeat_ > 0.f; }
+        float GetSamplesPerBeat() { return samplesPerBeat_; }
+
+    private:
+        static constexpr float kMidiClockTimeoutBeats{4.f};
+
+        uint32_t ticks_{};
+        uint32_t samples_{};
+        float samplesPerBeat_{};
+    };
+
+    /**
+     * @brief Dispatches the incoming messages: the CCs are mapped to the
+     * parameter they control and only their latest value is kept until the
+     * next block, so that a burst of CCs updates each parameter once. The
+     * notes trigger and the clock messages drive the tempo measurement. The
+     * values are normalized between 0 and 1.
+     */
+    class MidiMapper
+    {
+    public:
+        MidiMapper() {}
+        ~MidiMapper() {}
+
+        // Returns false if the message isn't handled here, like the CCs that
+        // act immediately.
+        bool Process(const MidiMessage &message)
+        {
+            switch (message.Type())
+            {
+            case kMidiControlChange:
+                return ProcessControlChange(message.data1, message.data2 / 127.f);
+            case kMidiNoteOn:
+                triggered_ = true;
+                return true;
+            case kMidiClock:
+                clock_.Tick();
+                return true;
+            case kMidiStart:
+                clock_.Restart();
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // The following return the changes since the previous call, one at a
+        // time, once per block.
+        bool PopParameter(uint8_t &channel, uint8_t &idx, float &value)
+        {
+            for (uint8_t i = 0; i < kMidiParameterChannels * kMidiParametersPerChannel; i++)
+            {
+                if (parameterChanged_[i])
+                {
+                    parameterChanged_[i] = false;
+                    channel = i / kMidiParametersPerChannel;
+                    idx = i % kMidiParametersPerChannel;
+                    value = parameterValues_[i];
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool PopPitchShift(uint8_t &channel, float &value)
+        {
+            return Pop(pitchShiftValues_, pitchShiftChanged_, channel, value);
+        }
+
+        bool PopSpectralFreeze(uint8_t &channel, float &value)
+        {
+            return Pop(spectralFreezeValues_, spectralFreezeChanged_, channel, value);
+        }
+
+        bool PopTrigger()
+        {
+            bool triggered = triggered_;
+            triggered_ = false;
+
+            return triggered;
+        }
+
+        // Drops the pending parameter changes.
+        void ClearParameters()
+        {
+            for (bool &changed : parameterChanged_)
+            {
+                changed = false;
+            }
+        }
+
+        MidiClock &GetClock() { return clock_; }
+
+    private:
+        bool ProcessControlChange(uint8_t cc, float value)
+        {
+            if (cc >= kMidiFirstParameterCc && cc < kMidiFirstParameterCc + kMidiParameterChannels * kMidiParametersPerChannel)
+            {
+                parameterValues_[cc - kMidiFirstParameterCc] = value;
+                parameterChanged_[cc - kMidiFirstParameterCc] = true;
+            }
+            else if (cc >= kMidiFirstPitchShiftCc && cc < kMidiFirstPitchShiftCc + kMidiEffectChannels)
+            {
+                pitchShiftValues_[cc - kMidiFirstPitchShiftCc] = value;
+                pitchShiftChanged_[cc - kMidiFirstPitchShiftCc] = true;
+            }
+            else if (cc >= kMidiFirstSpectralFreezeCc && cc < kMidiFirstSpectralFreezeCc + kMidiEffectChannels)
+            {
+                spectralFreezeValues_[cc - kMidiFirstSpectralFreezeCc] = value;
+                spectralFreezeChanged_[cc - kMidiFirstSpectralFreezeCc] = true;
+            }
+            else
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool Pop(const float *values, bool *changed, uint8_t &channel, float &value)
+        {
+            for (uint8_t i = 0; i < kMidiEffectChannels; i++)
+            {
+                if (changed[i])
+                {
+                    changed[i] = false;
+                    channel = i;
+                    value = values[i];
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        MidiClock clock_;
+        float parameterValues_[kMidiParameterChannels * kMidiParametersPerChannel]{};
+        bool parameterChanged_[kMidiParameterChannels * kMidiParametersPerChannel]{};
+        float pitchShiftValues_[kMidiEffectChannels]{};
+        bool pitchShiftChanged_[kMidiEffectChannels]{};
+        float spectralFreezeValues_[kMidiEffectChannels]{};
+        bool spectralFreezeChanged_[kMidiEffectChannels]{};
+        bool triggered_{};
+    };
+}
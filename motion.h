@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    // Events per arena. There are two arenas, one being played back while the
+    // other is written during a recording pass.
+    constexpr size_t kMotionArenaEvents{8192};
+    // Channels and parameters that can be recorded (left, right and both
+    // channels, four parameters each).
+    constexpr uint8_t kMotionChannels{3};
+    constexpr uint8_t kMotionParameters{4};
+
+    /**
+     * @brief A parameter change, 4 bytes: the samples elapsed since the
+     * previous event, the parameter (channel * 4 + index) in the top 4 bits
+     * and the value on 12 bits.
+     */
+    struct MotionEvent
+    {
+        uint16_t delta;
+        uint16_t data;
+    };
+
+    /**
+     * @brief Records parameter changes stamped with their loop-relative
+     * sample position and plays them back at the exact same sample.
+     *
+     * The motion loop has the length of the audio loop and restarts with it,
+     * so the movements stay in sync with the audio. A recording pass lasts
+     * until the end of the loop and merges the new changes with the recorded
+     * ones: once a parameter is touched, its old events are dropped until the
+     * end of the pass. Playback only compares the position with the time of the next
+     * event at every sample, and at most one event per parameter is kept at
+     * the same position, so at most 12 events are replayed at any sample.
+     */
+    class MotionSequencer
+    {
+    public:
+        MotionSequencer() {}
+        ~MotionSequencer() {}
+
+        void Init()
+        {
+            length_ = 0;
+            position_ = 0;
+            Clear();
+        }
+
+        // Drops all the recorded events, the loop keeps running.
+        void Clear()
+        {
+            recording_ = false;
+            writing_ = false;
+            readArena_ = 0;
+            counts_[0] = counts_[1] = 0;
+            dropped_ = 0;
+            Rewind();
+        }
+
+        void StartRecording()
+        {
+            if (recording_)
+            {
+                return;
+            }
+            recording_ = true;
+            if (!writing_)
+            {
+                BeginPass();
+            }
+        }
+
+        // The recorded events keep being merged until the end of the pass.
+        void StopRecording()
+        {
+            recording_ = false;
+        }
+
+        /**
+         * @brief Sets the length of the loop, in samples, to the one of the
+         * audio loop. The position wraps around if it's past the new end.
+         */
+        void SetLength(uint32_t length)
+        {
+            if (length == length_)
+            {
+                return;
+            }
+            length_ = length;
+            if (position_ >= length_)
+            {
+                Wrap();
+            }
+        }
+
+        // Restarts the loop from the beginning, when the audio loop restarts.
+        void Retrigger()
+        {
+            Wrap();
+        }
+
+        bool IsRecording() { return recording_; }
+        uint32_t GetLength() { return length_; }
+        uint32_t GetPosition() { return position_; }
+        size_t GetEventCount() { return counts_[readArena_]; }
+        // How many events were lost because the arena was full.
+        uint32_t GetDroppedEvents() { return dropped_; }
+
+        // Records a change of the given parameter at the current position.
+        void Record(uint8_t channel, uint8_t idx, float value)
+        {
+            if (!recording_ || channel >= kMotionChannels || idx >= kMotionParameters)
+            {
+                return;
+            }
+            uint8_t param = channel * kMotionParameters + idx;
+            uint16_t data = static_cast<uint16_t>(value * kMaxValue + 0.5f);
+            touched_ |= 1 << param;
+            // Only keep the latest value of a parameter at a given position.
+            size_t last = lastWritten_[param];
+            if (last < counts_[1 - readArena_] && lastWrittenTime_[param] == position_)
+            {
+                arenas_[1 - readArena_][last].data = param << 12 | data;
+
+                return;
+            }
+            lastWritten_[param] = Write(param, data, position_);
+            lastWrittenTime_[param] = position_;
+        }
+
+        /**
+         * @brief Returns the next event due at the current sample, if any.
+         * Must be called until it returns false, then Tick() must be called.
+         */
+        inline bool PopDueEvent(uint8_t &channel, uint8_t &idx, float &value)
+        {
+            while (read_ < counts_[readArena_] && position_ == nextTime_)
+            {
+                const MotionEvent &event = arenas_[readArena_][read_];
+                uint8_t param = event.data >> 12;
+                uint16_t data = event.data & kMaxValue;
+                Next();
+
+                // Parameters touched during the current pass are overwritten.
+                if (writing_)
+                {
+                    if (touched_ & (1 << param))
+                    {
+                        continue;
+                    }
+                    Write(param, data, position_);
+                }
+
+                channel = param / kMotionParameters;
+                idx = param % kMotionParameters;
+                value = data / static_cast<float>(kMaxValue);
+
+                return true;
+            }
+
+            return false;
+        }
+
+        // Advances of one sample. Nothing moves until the length is known.
+        inline void Tick()
+        {
+            if (0 == length_)
+            {
+                return;
+            }
+            if (++position_ >= length_)
+            {
+                Wrap();
+            }
+        }
+
+    private:
+        static constexpr uint16_t kMaxValue{0x0FFF};
+        // Parameter code of the events only used to extend the delta.
+        static constexpr uint8_t kWaitParam{0x0F};
+        static constexpr uint32_t kNoEvent{0xFFFFFFFF};
+
+        // Goes back to the beginning of the loop, where a pass ends and the
+        // next one begins if still recording.
+        void Wrap()
+        {
+            position_ = 0;
+            if (writing_)
+            {
+                EndPass();
+            }
+            Rewind();
+            if (recording_)
+            {
+                BeginPass();
+            }
+        }
+
+        void BeginPass()
+        {
+            writing_ = true;
+            touched_ = 0;
+            // A pass starting in the middle of the loop keeps the events that
+            // have already been played (the wait events leading to the next
+            // one may go past the current position).
+            MotionEvent *arena = arenas_[1 - readArena_];
+            size_t &count = counts_[1 - readArena_];
+            lastWriteTime_ = 0;
+            for (count = 0; count < read_ && lastWriteTime_ + arenas_[readArena_][count].delta <= position_; count++)
+            {
+                arena[count] = arenas_[readArena_][count];
+                lastWriteTime_ += arena[count].delta;
+            }
+            for (size_t &last : lastWritten_)
+            {
+                last = kMotionArenaEvents;
+            }
+        }
+
+        void EndPass()
+        {
+            writing_ = false;
+            readArena_ = 1 - readArena_;
+        }
+
+        void Rewind()
+        {
+            read_ = 0;
+            readTime_ = 0;
+            Seek();
+        }
+
+        // Moves to the next real event, skipping the wait events.
+        void Seek()
+        {
+            while (read_ < counts_[readArena_])
+            {
+                const MotionEvent &event = arenas_[readArena_][read_];
+                readTime_ += event.delta;
+                if ((event.data >> 12) != kWaitParam)
+                {
+                    nextTime_ = readTime_;
+
+                    return;
+                }
+                read_++;
+            }
+            nextTime_ = kNoEvent;
+        }
+
+        void Next()
+        {
+            read_++;
+            Seek();
+        }
+
+        // Returns the index of the written event, kMotionArenaEvents if the
+        // arena is full.
+        size_t Write(uint8_t param, uint16_t value, uint32_t time)
+        {
+            MotionEvent *arena = arenas_[1 - readArena_];
+            size_t &count = counts_[1 - readArena_];
+            uint32_t delta = time - lastWriteTime_;
+            while (delta > 0xFFFF)
+            {
+                if (count >= kMotionArenaEvents)
+                {
+                    dropped_++;
+
+                    return kMotionArenaEvents;
+                }
+                arena[count++] = {0xFFFF, static_cast<uint16_t>(kWaitParam << 12)};
+                delta -= 0xFFFF;
+                lastWriteTime_ += 0xFFFF;
+            }
+            if (count >= kMotionArenaEvents)
+            {
+                dropped_++;
+
+                return kMotionArenaEvents;
+            }
+            arena[count] = {static_cast<uint16_t>(delta), static_cast<uint16_t>(param << 12 | value)};
+            lastWriteTime_ = time;
+
+            return count++;
+        }
+
+        MotionEvent arenas_[2][kMotionArenaEvents]{};
+        size_t counts_[2]{};
+        size_t lastWritten_[kMotionChannels * kMotionParameters]{};
+        uint32_t lastWrittenTime_[kMotionChannels * kMotionParameters]{};
+        size_t readArena_{};
+        size_t read_{};
+        uint32_t readTime_{};
+        uint32_t nextTime_{kNoEvent};
+        uint32_t lastWriteTime_{};
+        uint32_t position_{};
+        uint32_t length_{};
+        uint16_t touched_{};
+        bool recording_{};
+        bool writing_{};
+        uint32_t dropped_{};
+    };
+}
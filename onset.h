@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    // Length of the pre-roll, in samples (~5ms @ 48KHz), must be a power of 2.
+    constexpr size_t kPreRollSamples{256};
+    // Release time of the envelope follower, in seconds.
+    constexpr float kOnsetReleaseTime{0.05f};
+    // An armed detector waits for the envelope to fall below this fraction of
+    // the threshold before detecting, so that a sound already playing when it
+    // gets armed doesn't trigger it.
+    constexpr float kOnsetArmRatio{0.5f};
+
+    /**
+     * @brief Detects the onsets in the input and delays it through a small
+     * pre-roll ring buffer, so that a recording started at the onset sample
+     * also gets the kPreRollSamples samples before it and no attack is lost.
+     *
+     * The detection is one-shot: it fires once after being armed, and it must
+     * be armed again for the next onset. It only compares the rectified input
+     * with the threshold at every sample, the envelope used to delay the
+     * arming is updated once per block from the peak of the block. The
+     * detection and the pre-roll only run while the detector is active and a
+     * threshold is set. The ring and the envelope are always kept up to date,
+     * and the output crossfades between the input and the delayed input when
+     * the pre-roll is switched, so that the jump of kPreRollSamples samples
+     * doesn't click.
+     */
+    class OnsetDetector
+    {
+    public:
+        OnsetDetector() {}
+        ~OnsetDetector() {}
+
+        void Init(float sampleRate, size_t blockSize)
+        {
+            Clear();
+            releaseCoeff_ = std::exp(-static_cast<float>(blockSize) / (kOnsetReleaseTime * sampleRate));
+            threshold_ = 0.f;
+            active_ = false;
+            armed_ = false;
+            arming_ = false;
+        }
+
+        // Sets the threshold (linear, 0 disables the detection). Setting it
+        // when it was disabled arms the detector.
+        void SetThreshold(float threshold)
+        {
+            bool enabling = threshold_ <= 0.f && threshold > 0.f;
+            threshold_ = threshold;
+            if (enabling)
+            {
+                Arm();
+            }
+            else if (threshold_ <= 0.f)
+            {
+                Disarm();
+            }
+        }
+
+        // Switches the detection and the pre-roll on and off (the threshold is
+        // kept).
+        void SetActive(bool active) { active_ = active; }
+
+        // Arms the detector for the next onset, as soon as the input is quiet.
+        void Arm()
+        {
+            armed_ = false;
+            arming_ = threshold_ > 0.f;
+        }
+
+        void Disarm()
+        {
+            armed_ = false;
+            arming_ = false;
+        }
+
+        bool IsEnabled() { return threshold_ > 0.f; }
+        bool IsArmed() { return armed_ || arming_; }
+        float GetEnvelope() { return envelope_; }
+
+        /**
+         * @brief Delays the input of kPreRollSamples samples while the detection
+         * is active and enabled, and returns true if the detector was armed and
+         * the (non delayed) input crossed the threshold at this sample, which
+         * disarms it. Must be called at every sample, even when disabled.
+         */
+        inline bool Process(float &left, float &right)
+        {
+            float level = std::fabs(left) > std::fabs(right) ? std::fabs(left) : std::fabs(right);
+            peak_ = level > peak_ ? level : peak_;
+
+            float delayedLeft = left_[pos_];
+            float delayedRight = right_[pos_];
+            left_[pos_] = left;
+            right_[pos_] = right;
+            pos_ = (pos_ + 1) & (kPreRollSamples - 1);
+
+            float target = active_ && threshold_ > 0.f ? 1.f : 0.f;
+            if (delayMix_ != target)
+            {
+                delayMix_ += delayMix_ < target ? kDelayFadeStep : -kDelayFadeStep;
+                delayMix_ = delayMix_ < 0.f ? 0.f : (delayMix_ > 1.f ? 1.f : delayMix_);
+            }
+            if (delayMix_ >= 1.f)
+            {
+                left = delayedLeft;
+                right = delayedRight;
+            }
+            else if (delayMix_ > 0.f)
+            {
+                left += (delayedLeft - left) * delayMix_;
+                right += (delayedRight - right) * delayMix_;
+            }
+
+            if (armed_ && active_ && level > threshold_)
+            {
+                armed_ = false;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        // Updates the envelope and completes a pending arming, once per block,
+        // even when disabled.
+        void ProcessBlock()
+        {
+            envelope_ = peak_ > envelope_ ? peak_ : envelope_ * releaseCoeff_;
+            peak_ = 0.f;
+            if (arming_ && envelope_ < threshold_ * kOnsetArmRatio)
+            {
+                armed_ = true;
+                arming_ = false;
+            }
+        }
+
+    private:
+        // The crossfade lasts as long as the pre-roll.
+        static constexpr float kDelayFadeStep{1.f / kPreRollSamples};
+
+        void Clear()
+        {
+            for (size_t i = 0; i < kPreRollSamples; i++)
+            {
+                left_[i] = right_[i] = 0.f;
+            }
+            pos_ = 0;
+            peak_ = 0.f;
+            envelope_ = 0.f;
+            delayMix_ = 0.f;
+        }
+
+        float left_[kPreRollSamples]{};
+        float right_[kPreRollSamples]{};
+        size_t pos_{};
+        float peak_{};
+        float envelope_{};
+        float delayMix_{};
+        float releaseCoeff_{};
+        float threshold_{};
+        bool active_{};
+        bool armed_{};
+        bool arming_{};
+    };
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    // Length of the window of each read head, in samples (~85ms @ 48KHz). The
+    // longer the window, the finer the pitch resolution on steady tones, but
+    // the more smeared the transients.
+    constexpr size_t kPitchShifterWindowSamples{4096};
+    // Length of the crossfade with the input when the transposition is
+    // switched on or off, in samples (~10ms @ 48KHz).
+    constexpr float kPitchShifterFadeSamples{480.f};
+    // Size of the precomputed window table.
+    constexpr size_t kPitchShifterTableSize{1024};
+    // Transposition range, in semitones.
+    constexpr float kMinPitchShift{-24.f};
+    constexpr float kMaxPitchShift{24.f};
+
+    /**
+     * @brief Delay-line pitch shifter that changes the pitch without changing
+     * the duration of the signal, so the loop timing is not affected.
+     *
+     * Two read heads, half a window apart, sweep through a short delay line
+     * at a speed that depends on the transposition ratio. Their outputs are
+     * crossfaded with a Hann window whose shifted copies sum to unity. The
+     * per-sample work is the same whatever the pitch, so the cost is fixed.
+     */
+    class PitchShifter
+    {
+    public:
+        PitchShifter() {}
+        ~PitchShifter() {}
+
+        void Init()
+        {
+            window_ = Window();
+            for (size_t i = 0; i < kBufferSamples; i++)
+            {
+                buffer_[i] = 0.f;
+            }
+            writePos_ = 0;
+            phase_ = 0.f;
+            mix_ = 0.f;
+            SetPitch(0.f);
+        }
+
+        /**
+         * @brief Sets the transposition, in semitones. Must not be called from
+         * the audio callback at every sample, as it uses std::pow.
+         */
+        void SetPitch(float semitones)
+        {
+            semitones = semitones < kMinPitchShift ? kMinPitchShift : (semitones > kMaxPitchShift ? kMaxPitchShift : semitones);
+            pitch_ = semitones;
+            ratio_ = std::pow(2.f, semitones / 12.f);
+            // The delay changes by (1 - ratio) samples per sample.
+            phaseInc_ = (1.f - ratio_) / kPitchShifterWindowSamples;
+        }
+
+        float GetPitch() { return pitch_; }
+        float GetRatio() { return ratio_; }
+        bool IsActive() { return pitch_ != 0.f; }
+
+        float Process(float input)
+        {
+            buffer_[writePos_] = input;
+            writePos_ = (writePos_ + 1) & kBufferMask;
+
+            // Crossfade with the input, as the heads are up to a window behind
+            // it. The delay line is always filled, so that the heads have
+            // something to read as soon as the pitch changes.
+            if (IsActive())
+            {
+                mix_ = mix_ + kFadeStep > 1.f ? 1.f : mix_ + kFadeStep;
+            }
+            else
+            {
+                mix_ = mix_ - kFadeStep < 0.f ? 0.f : mix_ - kFadeStep;
+            }
+            if (mix_ <= 0.f)
+            {
+                return input;
+            }
+
+            // std::floor can leave exactly 1 when the phase is slightly below
+            // 0, which would read past the end of the window table.
+            phase_ += phaseInc_;
+            if (phase_ >= 1.f)
+            {
+                phase_ -= 1.f;
+            }
+            else if (phase_ < 0.f)
+            {
+                phase_ += 1.f;
+                if (phase_ >= 1.f)
+                {
+                    phase_ = 0.f;
+                }
+            }
+
+            float phaseB = phase_ + 0.5f;
+            phaseB -= static_cast<int32_t>(phaseB);
+
+            float shifted = ReadHead(phase_) + ReadHead(phaseB);
+
+            return mix_ >= 1.f ? shifted : input + (shifted - input) * mix_;
+        }
+
+    private:
+        static constexpr float kPi{3.14159265358979f};
+        // The delay line must hold a whole window plus the interpolation point.
+        static constexpr size_t kBufferSamples{kPitchShifterWindowSamples * 2};
+        static constexpr size_t kBufferMask{kBufferSamples - 1};
+        static constexpr float kFadeStep{1.f / kPitchShifterFadeSamples};
+
+        // The window table is shared by all the instances and built once.
+        static const float *Window()
+        {
+            static float window[kPitchShifterTableSize + 1];
+            static bool built{};
+            if (!built)
+            {
+                // The table covers one full window period, plus a guard point.
+                for (size_t i = 0; i <= kPitchShifterTableSize; i++)
+                {
+                    float s = std::sin(kPi * i / kPitchShifterTableSize);
+                    window[i] = s * s;
+                }
+                built = true;
+            }
+
+            return window;
+        }
+
+        inline float ReadHead(float phase)
+        {
+            // Delay, in samples, behind the write head (the write head has
+            // already moved past the newest sample).
+            float delay = phase * kPitchShifterWindowSamples + 2.f;
+            float readPos = writePos_ + kBufferSamples - delay;
+            int32_t intPos = static_cast<int32_t>(readPos);
+            float frac = readPos - intPos;
+            float a = buffer_[intPos & kBufferMask];
+            float b = buffer_[(intPos + 1) & kBufferMask];
+
+            float tablePos = phase * kPitchShifterTableSize;
+            int32_t tableIdx = static_cast<int32_t>(tablePos);
+            float tableFrac = tablePos - tableIdx;
+            float gain = window_[tableIdx] + (window_[tableIdx + 1] - window_[tableIdx]) * tableFrac;
+
+            return (a + (b - a) * frac) * gain;
+        }
+
+        float buffer_[kBufferSamples]{};
+        const float *window_{};
+        size_t writePos_{};
+        float phase_{};
+        float mix_{};
+        float phaseInc_{};
+        float pitch_{};
+        float ratio_{1.f};
+    };
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+/**
+ * Hot-path profiler. Probes are placed with PROFILE_SCOPE and measure the
+ * enclosing scope with the DWT cycle counter on the device, and with rdtsc (or
+ * steady_clock) on the host. On the device the statistics are written to the
+ * SD card, or printed over USB serial when PROFILING_SERIAL is also defined
+ * (MIDI is then off). Everything compiles to nothing unless PROFILING is
+ * defined (build with "make PROFILING=1", and add "PROFILING_OUTPUT=serial"
+ * for the serial output).
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    enum class ProfilerStage
+    {
+        CALLBACK,
+        LOOPER,
+        PITCH_SHIFTER,
+        MIDI,
+        SPECTRAL_FREEZE,
+        SPECTRAL_FREEZE_WORK,
+        MOTION,
+        ONSET,
+        LAST,
+    };
+
+    constexpr const char *kProfilerStageNames[]{
+        "callback",
+        "looper",
+        "pitch shifter",
+        "midi",
+        "spectral freeze",
+        "spectral freeze fft",
+        "motion",
+        "onset",
+    };
+    static_assert(sizeof(kProfilerStageNames) / sizeof(kProfilerStageNames[0]) == static_cast<size_t>(ProfilerStage::LAST), "Missing profiler stage name");
+}
+
+#ifdef PROFILING
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__arm__)
+#include "hw.h"
+#ifndef PROFILING_SERIAL
+#include "fatfs.h"
+#endif
+#include "stm32h7xx.h"
+#else
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+namespace wreath
+{
+    // One histogram bin per power of two.
+    constexpr size_t kProfilerBins{32};
+    // How often the statistics are written out on the device, in ms.
+    constexpr uint32_t kProfilerDumpIntervalMs{2000};
+
+    struct ProfilerStats
+    {
+        uint32_t count;
+        uint64_t total;
+        uint32_t min;
+        uint32_t max;
+        uint32_t histogram[kProfilerBins];
+    };
+
+    ProfilerStats profilerStats[static_cast<size_t>(ProfilerStage::LAST)]{};
+
+    inline uint32_t ProfilerNow()
+    {
+#if defined(__arm__)
+        return DWT->CYCCNT;
+#elif defined(__x86_64__) || defined(__i386__)
+        return static_cast<uint32_t>(__rdtsc());
+#else
+        return static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    inline void ProfilerRecord(ProfilerStage stage, uint32_t ticks)
+    {
+        ProfilerStats &stats = profilerStats[static_cast<size_t>(stage)];
+        if (stats.count == 0 || ticks < stats.min)
+        {
+            stats.min = ticks;
+        }
+        if (ticks > stats.max)
+        {
+            stats.max = ticks;
+        }
+        stats.count++;
+        stats.total += ticks;
+        // Bin i holds the values in [2^i, 2^(i+1)), 0 goes in the first one.
+        stats.histogram[ticks == 0 ? 0 : kProfilerBins - __builtin_clz(ticks) - 1]++;
+    }
+
+    class ProfilerScope
+    {
+    public:
+        ProfilerScope(ProfilerStage stage) : stage_{stage}, start_{ProfilerNow()} {}
+        ~ProfilerScope() { ProfilerRecord(stage_, ProfilerNow() - start_); }
+
+    private:
+        ProfilerStage stage_;
+        uint32_t start_;
+    };
+
+    inline void ResetProfiler()
+    {
+        for (ProfilerStats &stats : profilerStats)
+        {
+            stats = {};
+        }
+    }
+
+    // Formats the statistics and passes them line by line to the writer,
+    // without the line endings.
+    template <typename Writer>
+    inline void WriteProfiler(Writer write)
+    {
+        char line[64];
+        for (size_t i = 0; i < static_cast<size_t>(ProfilerStage::LAST); i++)
+        {
+            ProfilerStats &stats = profilerStats[i];
+            unsigned long avg = stats.count > 0 ? static_cast<unsigned long>(stats.total / stats.count) : 0;
+            std::snprintf(line, sizeof(line), "%s: min %lu avg %lu max %lu (%lu calls)", kProfilerStageNames[i], static_cast<unsigned long>(stats.min), avg, static_cast<unsigned long>(stats.max), static_cast<unsigned long>(stats.count));
+            write(line);
+            for (size_t j = 0; j < kProfilerBins; j++)
+            {
+                if (stats.histogram[j] > 0)
+                {
+                    std::snprintf(line, sizeof(line), "  >= %lu: %lu", 1ul << j, static_cast<unsigned long>(stats.histogram[j]));
+                    write(line);
+                }
+            }
+        }
+    }
+
+#if defined(__arm__)
+    inline void InitProfilerCounter()
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        // The Cortex-M7 DWT must be unlocked before being enabled.
+        DWT->LAR = 0xC5ACCE55;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+#ifdef PROFILING_SERIAL
+    // The statistics go over USB serial, which takes the port from MIDI.
+    inline void InitProfiler()
+    {
+        InitProfilerCounter();
+        hw.StartLog();
+        ResetProfiler();
+    }
+
+    // Prints the statistics over USB serial. They're updated by the audio
+    // callback while being printed, so they may be slightly off.
+    inline void DumpProfiler()
+    {
+        WriteProfiler([](const char *line) { hw.PrintLine("%s", line); });
+    }
+#else
+    // The statistics go to the SD card, so that the USB port stays available
+    // for MIDI and all the stages can be profiled.
+    constexpr const char *kProfilerFileName{"profiler.txt"};
+
+    SdmmcHandler profilerSdmmc;
+    FatFSInterface profilerFatFs;
+    FIL profilerFile;
+    bool profilerFatFsMounted{};
+
+    inline void InitProfiler()
+    {
+        InitProfilerCounter();
+
+        SdmmcHandler::Config config;
+        config.Defaults();
+        profilerSdmmc.Init(config);
+        profilerFatFs.Init(FatFSInterface::Config::MEDIA_SD);
+        profilerFatFsMounted = FR_OK == f_mount(&profilerFatFs.GetSDFileSystem(), "/", 1);
+
+        ResetProfiler();
+    }
+
+    // Overwrites the file on the SD card with the latest statistics. They're
+    // updated by the audio callback while being written, so they may be
+    // slightly off.
+    inline void DumpProfiler()
+    {
+        if (!profilerFatFsMounted || FR_OK != f_open(&profilerFile, kProfilerFileName, FA_CREATE_ALWAYS | FA_WRITE))
+        {
+            return;
+        }
+        WriteProfiler([](const char *line) {
+            UINT written;
+            f_write(&profilerFile, line, std::strlen(line), &written);
+            f_write(&profilerFile, "\n", 1, &written);
+        });
+        f_close(&profilerFile);
+    }
+#endif
+
+    inline void ProcessProfiler()
+    {
+        static uint32_t lastDumpTime{};
+        if (System::GetNow() - lastDumpTime > kProfilerDumpIntervalMs)
+        {
+            lastDumpTime = System::GetNow();
+            DumpProfiler();
+            ResetProfiler();
+        }
+    }
+#else
+    inline void InitProfiler()
+    {
+        ResetProfiler();
+    }
+
+    // Writes the statistics to the given file.
+    inline bool DumpProfiler(const char *path)
+    {
+        FILE *file = std::fopen(path, "w");
+        if (!file)
+        {
+            return false;
+        }
+        WriteProfiler([file](const char *line) { std::fprintf(file, "%s\n", line); });
+        std::fclose(file);
+
+        return true;
+    }
+#endif
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) wreath::ProfilerScope PROFILE_CONCAT(profilerScope, __LINE__){stage}
+
+#else
+
+#define PROFILE_SCOPE(stage)
+
+namespace wreath
+{
+    inline void InitProfiler() {}
+    inline void ProcessProfiler() {}
+}
+
+#endif
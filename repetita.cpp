@@ -1,31 +1,88 @@
 #include "repetita.h"
 #include "ui.h"
+#include "profiler.h"
 #include <cstring>
 
 using namespace wreath;
 
 void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
 {
-    // ProcessControls();
-    // ProcessUi();
+    PROFILE_SCOPE(ProfilerStage::CALLBACK);
+
+    ProcessControls();
+    ProcessUi();
+
+    {
+        PROFILE_SCOPE(ProfilerStage::MIDI);
+        ProcessMidi(size);
+    }
+
+    {
+        PROFILE_SCOPE(ProfilerStage::SPECTRAL_FREEZE_WORK);
+        spectralFreezes[0].Work();
+        spectralFreezes[1].Work();
+    }
+
+    UpdateDryWetMix();
+    bool postProcessingActive{IsPostProcessing()};
+    bool postProcessing{postProcessingActive || postProcessingMix > 0.f};
 
     for (size_t i = 0; i < size; i++)
     {
         float leftIn{IN_L[i]};
         float rightIn{IN_R[i]};
 
+        {
+            PROFILE_SCOPE(ProfilerStage::ONSET);
+            ProcessOnset(leftIn, rightIn);
+        }
+
+        {
+            PROFILE_SCOPE(ProfilerStage::MOTION);
+            ProcessMotion();
+        }
+
         float leftOut{};
         float rightOut{};
-        looper.Process(leftIn, rightIn, leftOut, rightOut);
+        {
+            PROFILE_SCOPE(ProfilerStage::LOOPER);
+            looper.Process(leftIn, rightIn, leftOut, rightOut);
+        }
+
+        // The post-processors always run, so their buffers are up to date
+        // when they get activated.
+        float leftShifted{};
+        float rightShifted{};
+        {
+            PROFILE_SCOPE(ProfilerStage::SPECTRAL_FREEZE);
+            leftShifted = spectralFreezes[0].Process(leftOut);
+            rightShifted = spectralFreezes[1].Process(rightOut);
+        }
+        {
+            PROFILE_SCOPE(ProfilerStage::PITCH_SHIFTER);
+            leftShifted = pitchShifters[0].Process(leftShifted);
+            rightShifted = pitchShifters[1].Process(rightShifted);
+        }
+        if (postProcessing)
+        {
+            StepPostProcessingMix(postProcessingActive);
+            float leftWet = leftOut + (leftShifted - leftOut) * postProcessingMix;
+            float rightWet = rightOut + (rightShifted - rightOut) * postProcessingMix;
+            leftOut = leftIn * (1.f - dryWetMix) + leftWet * dryWetMix;
+            rightOut = rightIn * (1.f - dryWetMix) + rightWet * dryWetMix;
+        }
 
         OUT_L[i] = leftOut;
         OUT_R[i] = rightOut;
     }
+
+    onsetDetector.ProcessBlock();
 }
 
 int main(void)
 {
     InitHw();
+    InitProfiler();
 
     StereoLooper::Conf conf
     {
@@ -36,13 +93,20 @@ int main(void)
     };
 
     looper.Init(hw.AudioSampleRate(), conf);
+    pitchShifters[0].Init();
+    pitchShifters[1].Init();
+    spectralFreezes[0].Init(hw.AudioBlockSize());
+    spectralFreezes[1].Init(hw.AudioBlockSize());
+    motion.Init();
+    onsetDetector.Init(hw.AudioSampleRate(), hw.AudioBlockSize());
 
-    // InitUi();
+    InitUi();
 
     hw.StartAudio(AudioCallback);
 
     while (1)
     {
         ProcessStorage();
+        ProcessProfiler();
     }
 }
\ No newline at end of file
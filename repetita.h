@@ -1,6 +1,8 @@
 #pragma once
 
 #include "wreath/stereo_looper.h"
+#include "pitch_shifter.h"
+#include "spectral_freeze.h"
 
 namespace wreath
 {
@@ -8,4 +10,43 @@ namespace wreath
     constexpr float kMaxSpeedMult{4.f};
 
     StereoLooper looper;
+    PitchShifter pitchShifters[2];
+    SpectralFreeze spectralFreezes[2];
+
+    // Length of the handover between the looper's wet signal and the
+    // post-processed one, in samples (~10ms @ 48KHz).
+    constexpr float kPostProcessingFadeSamples{480.f};
+
+    // Dry/wet balance, applied after the looper when post-processing the wet
+    // signal (the looper then outputs a fully wet signal).
+    float dryWetMix{};
+    // How much of the wet signal comes from the post-processing, ramps between
+    // 0 and 1 when the post-processing is switched.
+    float postProcessingMix{};
+
+    inline bool IsPostProcessing()
+    {
+        return pitchShifters[0].IsActive() || pitchShifters[1].IsActive() || spectralFreezes[0].IsActive() || spectralFreezes[1].IsActive();
+    }
+
+    // The looper outputs a fully wet signal for as long as the post-processing
+    // or its handover lasts, the dry/wet balance is then applied afterwards.
+    inline void UpdateDryWetMix()
+    {
+        looper.dryWetMix = IsPostProcessing() || postProcessingMix > 0.f ? 1.f : dryWetMix;
+    }
+
+    // Moves the handover of one sample towards the post-processing state.
+    inline void StepPostProcessingMix(bool active)
+    {
+        constexpr float step{1.f / kPostProcessingFadeSamples};
+        if (active)
+        {
+            postProcessingMix = postProcessingMix + step > 1.f ? 1.f : postProcessingMix + step;
+        }
+        else
+        {
+            postProcessingMix = postProcessingMix - step < 0.f ? 0.f : postProcessingMix - step;
+        }
+    }
 }
\ No newline at end of file
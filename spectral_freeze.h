@@ -0,0 +1,400 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    // FFT size, in samples (~21ms @ 48KHz).
+    constexpr size_t kSpectralFrameSize{1024};
+    constexpr size_t kSpectralFrameBits{10};
+    // Distance between two consecutive frames (4x overlap).
+    constexpr size_t kSpectralHopSize{kSpectralFrameSize / 4};
+
+    /**
+     * @brief Spectral freeze: captures the magnitude spectrum of the signal at
+     * freeze time and continuously resynthesises it with random phases,
+     * through a windowed overlap-add.
+     *
+     * Frames are synthesised two at a time with a single complex inverse FFT
+     * (one in the real part and one in the imaginary part). The FFT work is
+     * split in small units and a fixed number of them is done at every block
+     * by Work(), so that no single callback takes much more time than the
+     * others. All the frames are statically allocated, the tables are shared.
+     */
+    class SpectralFreeze
+    {
+    public:
+        SpectralFreeze() {}
+        ~SpectralFreeze() {}
+
+        void Init(size_t blockSize)
+        {
+            const Tables &tables = GetTables();
+            cos_ = tables.cos;
+            window_ = tables.window;
+            bitReversed_ = tables.bitReversed;
+            for (size_t i = 0; i < kSpectralFrameSize; i++)
+            {
+                history_[i] = 0.f;
+            }
+
+            // Two frames must be synthesised every two hops, with some margin.
+            size_t pairUnits = kSpectralFrameSize / 2 - 1 + kFftUnits;
+            unitsPerBlock_ = (pairUnits * blockSize * 5 / 4 + 2 * kSpectralHopSize - 1) / (2 * kSpectralHopSize);
+
+            historyPos_ = 0;
+            amount_ = 0.f;
+            playing_ = false;
+            job_ = Job::IDLE;
+            underruns_ = 0;
+        }
+
+        /**
+         * @brief Sets how much of the frozen spectrum is mixed with the input.
+         * The spectrum is captured when the amount goes above 0 and released
+         * when it goes back to 0.
+         */
+        void SetFreeze(float amount)
+        {
+            if (amount > 0.f && amount_ <= 0.f)
+            {
+                StartCapture();
+            }
+            else if (amount <= 0.f)
+            {
+                playing_ = false;
+                job_ = Job::IDLE;
+            }
+            amount_ = amount;
+        }
+
+        bool IsActive() { return amount_ > 0.f; }
+        size_t GetUnitsPerBlock() { return unitsPerBlock_; }
+        // How many times a frame was not ready in time and the previous one
+        // was repeated.
+        uint32_t GetUnderruns() { return underruns_; }
+
+        // Does a fixed amount of the pending FFT work, once per block.
+        void Work()
+        {
+            for (size_t n = 0; n < unitsPerBlock_ && Job::IDLE != job_; n++)
+            {
+                DoUnit();
+            }
+        }
+
+        float Process(float input)
+        {
+            history_[historyPos_] = input;
+            historyPos_ = (historyPos_ + 1) & kFrameMask;
+
+            if (!playing_)
+            {
+                return input;
+            }
+
+            float frozen{};
+            for (size_t j = 0; j < kActiveFrames; j++)
+            {
+                size_t pos = hopPos_ + j * kSpectralHopSize;
+                frozen += window_[pos] * frames_[active_[j]][pos];
+            }
+
+            if (++hopPos_ == kSpectralHopSize)
+            {
+                hopPos_ = 0;
+                NextFrame();
+            }
+
+            return input + (frozen - input) * amount_;
+        }
+
+    private:
+        static constexpr float kPi{3.14159265358979f};
+        static constexpr size_t kFrameMask{kSpectralFrameSize - 1};
+        static constexpr size_t kActiveFrames{kSpectralFrameSize / kSpectralHopSize};
+        // Four frames playing, the second frame of the current pair waiting and
+        // two frames being synthesised.
+        static constexpr size_t kSlots{kActiveFrames + 3};
+        static constexpr size_t kFftUnits{kSpectralFrameBits * kSpectralFrameSize / 2};
+
+        struct Tables
+        {
+            float cos[kSpectralFrameSize];
+            float window[kSpectralFrameSize];
+            uint16_t bitReversed[kSpectralFrameSize];
+        };
+
+        // The tables are shared by all the instances and built once.
+        static const Tables &GetTables()
+        {
+            static Tables tables;
+            static bool built{};
+            if (!built)
+            {
+                for (size_t i = 0; i < kSpectralFrameSize; i++)
+                {
+                    tables.cos[i] = std::cos(2.f * kPi * i / kSpectralFrameSize);
+                    tables.window[i] = 0.5f - 0.5f * tables.cos[i];
+                    uint16_t reversed{};
+                    for (size_t b = 0; b < kSpectralFrameBits; b++)
+                    {
+                        reversed |= ((i >> b) & 1) << (kSpectralFrameBits - 1 - b);
+                    }
+                    tables.bitReversed[i] = reversed;
+                }
+                built = true;
+            }
+
+            return tables;
+        }
+
+        enum class Job
+        {
+            IDLE,
+            COPY,
+            CLEAR,
+            FORWARD_FFT,
+            MAGNITUDE,
+            PHASES,
+            INVERSE_FFT,
+        };
+
+        void StartCapture()
+        {
+            for (size_t i = 0; i < kSlots; i++)
+            {
+                slotFree_[i] = i >= kActiveFrames;
+            }
+            for (size_t j = 0; j < kActiveFrames; j++)
+            {
+                active_[j] = j;
+            }
+            hopPos_ = 0;
+            nextIsSecond_ = false;
+            pairReady_ = false;
+            playing_ = false;
+            pairA_ = TakeSlot();
+            pairB_ = TakeSlot();
+            // The copy starts right away, in the same block, so the captured
+            // samples are the ones before the freeze. They're read oldest
+            // first, faster than they're overwritten by Process.
+            captureStart_ = historyPos_;
+            StartJob(Job::COPY);
+        }
+
+        size_t TakeSlot()
+        {
+            for (size_t i = 0; i < kSlots; i++)
+            {
+                if (slotFree_[i])
+                {
+                    slotFree_[i] = false;
+
+                    return i;
+                }
+            }
+
+            return 0;
+        }
+
+        void StartJob(Job job)
+        {
+            job_ = job;
+            unit_ = 0;
+        }
+
+        void StartPair()
+        {
+            pairA_ = TakeSlot();
+            pairB_ = TakeSlot();
+            pairReady_ = false;
+            StartJob(Job::PHASES);
+        }
+
+        void NextFrame()
+        {
+            size_t retired = active_[kActiveFrames - 1];
+            for (size_t j = kActiveFrames - 1; j > 0; j--)
+            {
+                active_[j] = active_[j - 1];
+            }
+
+            if (nextIsSecond_)
+            {
+                active_[0] = secondSlot_;
+                nextIsSecond_ = false;
+                slotFree_[retired] = true;
+
+                return;
+            }
+
+            if (!pairReady_)
+            {
+                // Repeat the oldest frame and try again at the next hop.
+                active_[0] = retired;
+                underruns_++;
+
+                return;
+            }
+
+            // The next pair has two hops to be synthesised.
+            active_[0] = pairA_;
+            secondSlot_ = pairB_;
+            nextIsSecond_ = true;
+            slotFree_[retired] = true;
+            StartPair();
+        }
+
+        inline float Sin(size_t idx)
+        {
+            return cos_[(idx + kSpectralFrameSize * 3 / 4) & kFrameMask];
+        }
+
+        inline uint32_t Random()
+        {
+            random_ ^= random_ << 13;
+            random_ ^= random_ >> 17;
+            random_ ^= random_ << 5;
+
+            return random_;
+        }
+
+        // One radix-2 butterfly of the in-place FFT on the pair's frames.
+        inline void Butterfly(bool inverse)
+        {
+            size_t stage = unit_ / (kSpectralFrameSize / 2);
+            size_t b = unit_ % (kSpectralFrameSize / 2);
+            size_t half = 1 << stage;
+            size_t i = ((b >> stage) << (stage + 1)) + (b & (half - 1));
+            size_t k = (b & (half - 1)) << (kSpectralFrameBits - 1 - stage);
+
+            float *re = frames_[pairA_];
+            float *im = frames_[pairB_];
+            float wr = cos_[k];
+            float wi = inverse ? Sin(k) : -Sin(k);
+            float tr = wr * re[i + half] - wi * im[i + half];
+            float ti = wr * im[i + half] + wi * re[i + half];
+            re[i + half] = re[i] - tr;
+            im[i + half] = im[i] - ti;
+            re[i] += tr;
+            im[i] += ti;
+        }
+
+        void DoUnit()
+        {
+            float *re = frames_[pairA_];
+            float *im = frames_[pairB_];
+
+            switch (job_)
+            {
+            case Job::COPY:
+            {
+                size_t dst = bitReversed_[unit_];
+                re[dst] = history_[(captureStart_ + unit_) & kFrameMask] * window_[unit_];
+                im[dst] = 0.f;
+                if (++unit_ == kSpectralFrameSize)
+                {
+                    StartJob(Job::CLEAR);
+                }
+            }
+            break;
+            case Job::CLEAR:
+                // Silence the frames that play until the first pair is ready.
+                for (size_t j = 0; j < kActiveFrames; j++)
+                {
+                    frames_[active_[j]][unit_] = 0.f;
+                }
+                if (++unit_ == kSpectralFrameSize)
+                {
+                    StartJob(Job::FORWARD_FFT);
+                }
+                break;
+            case Job::FORWARD_FFT:
+                Butterfly(false);
+                if (++unit_ == kFftUnits)
+                {
+                    StartJob(Job::MAGNITUDE);
+                }
+                break;
+            case Job::MAGNITUDE:
+                // See Job::PHASES for the scaling.
+                magnitude_[unit_] = std::sqrt(re[unit_] * re[unit_] + im[unit_] * im[unit_]) * kSynthesisGain;
+                if (++unit_ == kSpectralFrameSize / 2)
+                {
+                    StartJob(Job::PHASES);
+                }
+                break;
+            case Job::PHASES:
+            {
+                // Bins k and N-k of two hermitian spectra with random phases,
+                // packed in a single complex spectrum and stored in bit reversed
+                // order for the inverse FFT. DC and Nyquist are left out.
+                if (0 == unit_)
+                {
+                    re[0] = im[0] = 0.f;
+                    re[bitReversed_[kSpectralFrameSize / 2]] = im[bitReversed_[kSpectralFrameSize / 2]] = 0.f;
+                }
+                size_t k = unit_ + 1;
+                size_t alpha = Random() & kFrameMask;
+                size_t beta = Random() & kFrameMask;
+                float m = magnitude_[k];
+                float ca = cos_[alpha], sa = Sin(alpha);
+                float cb = cos_[beta], sb = Sin(beta);
+                re[bitReversed_[k]] = m * (ca - sb);
+                im[bitReversed_[k]] = m * (sa + cb);
+                re[bitReversed_[kSpectralFrameSize - k]] = m * (ca + sb);
+                im[bitReversed_[kSpectralFrameSize - k]] = m * (cb - sa);
+                if (++unit_ == kSpectralFrameSize / 2 - 1)
+                {
+                    StartJob(Job::INVERSE_FFT);
+                }
+            }
+            break;
+            case Job::INVERSE_FFT:
+                Butterfly(true);
+                if (++unit_ == kFftUnits)
+                {
+                    job_ = Job::IDLE;
+                    pairReady_ = true;
+                    playing_ = true;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        // Keeps the power of the input (Parseval): the Hann window keeps 3/8
+        // of it, the inverse FFT is not normalized (N^2), and the 4x
+        // overlap-add of uncorrelated Hann windowed frames adds 3/2 of it.
+        static constexpr float kSynthesisGain{4.f / (3.f * kSpectralFrameSize)};
+
+        float frames_[kSlots][kSpectralFrameSize]{};
+        bool slotFree_[kSlots]{};
+        size_t active_[kActiveFrames]{};
+        float history_[kSpectralFrameSize]{};
+        float magnitude_[kSpectralFrameSize / 2]{};
+        const float *cos_{};
+        const float *window_{};
+        const uint16_t *bitReversed_{};
+
+        size_t historyPos_{};
+        size_t captureStart_{};
+        size_t hopPos_{};
+        size_t pairA_{};
+        size_t pairB_{};
+        size_t secondSlot_{};
+        bool pairReady_{};
+        bool nextIsSecond_{};
+        bool playing_{};
+        float amount_{};
+        Job job_{Job::IDLE};
+        size_t unit_{};
+        size_t unitsPerBlock_{};
+        uint32_t random_{0x9E3779B9};
+        uint32_t underruns_{};
+    };
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/**
+ * Minimal benchmark helper for the host benchmarks: times a function over a
+ * number of samples and returns the average time per sample, in ns.
+ */
+
+#include <chrono>
+#include <cstddef>
+
+namespace wreath
+{
+    template <typename Function>
+    double NsPerSample(size_t samples, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function(samples);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        return elapsed.count() / samples;
+    }
+}
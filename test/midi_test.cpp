@@ -0,0 +1,295 @@
+#include "midi.h"
+#include "test.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+using namespace wreath;
+
+// Parses the bytes and collects the messages.
+size_t Parse(MidiParser &parser, const uint8_t *bytes, size_t size, MidiMessage *messages)
+{
+    size_t count{};
+    MidiMessage message;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (parser.Parse(bytes[i], message))
+        {
+            messages[count++] = message;
+        }
+    }
+
+    return count;
+}
+
+bool Equals(const MidiMessage &message, uint8_t status, uint8_t data1, uint8_t data2)
+{
+    return message.status == status && message.data1 == data1 && message.data2 == data2;
+}
+
+void TestRunningStatus()
+{
+    MidiParser parser;
+    MidiMessage messages[8];
+    // Two CCs and a note on with running status, then a note on with no
+    // velocity, which is a note off.
+    const uint8_t bytes[]{0xB3, 20, 64, 21, 127, 0x90, 60, 100, 60, 0};
+    size_t count = Parse(parser, bytes, sizeof(bytes), messages);
+    CHECK(4 == count);
+    CHECK(Equals(messages[0], 0xB3, 20, 64));
+    CHECK(kMidiControlChange == messages[0].Type());
+    CHECK(3 == messages[0].GetChannel());
+    CHECK(Equals(messages[1], 0xB3, 21, 127));
+    CHECK(Equals(messages[2], 0x90, 60, 100));
+    CHECK(Equals(messages[3], 0x80, 60, 0));
+    CHECK(kMidiNoteOff == messages[3].Type());
+}
+
+void TestInterleavedRealTime()
+{
+    MidiParser parser;
+    MidiMessage messages[8];
+    // Clock pulses in the middle of a CC don't break it, nor the running
+    // status.
+    const uint8_t bytes[]{0xB0, 0xF8, 20, 0xF8, 64, 0xFA, 21, 0xF8, 10};
+    size_t count = Parse(parser, bytes, sizeof(bytes), messages);
+    CHECK(6 == count);
+    CHECK(Equals(messages[0], kMidiClock, 0, 0));
+    CHECK(Equals(messages[1], kMidiClock, 0, 0));
+    CHECK(Equals(messages[2], 0xB0, 20, 64));
+    CHECK(Equals(messages[3], kMidiStart, 0, 0));
+    CHECK(kMidiStart == messages[3].Type());
+    CHECK(Equals(messages[4], kMidiClock, 0, 0));
+    CHECK(Equals(messages[5], 0xB0, 21, 10));
+}
+
+void TestSysEx()
+{
+    MidiParser parser;
+    MidiMessage messages[8];
+    // The SysEx data bytes are skipped, with a clock pulse inside, and the
+    // SysEx cancels the running status.
+    const uint8_t bytes[]{0xB0, 20, 64, 0xF0, 0x7D, 0x01, 0xF8, 0x02, 0xF7, 21, 10, 0xB0, 22, 5};
+    size_t count = Parse(parser, bytes, sizeof(bytes), messages);
+    CHECK(3 == count);
+    CHECK(Equals(messages[0], 0xB0, 20, 64));
+    CHECK(Equals(messages[1], kMidiClock, 0, 0));
+    CHECK(Equals(messages[2], 0xB0, 22, 5));
+}
+
+void TestSingleDataByte()
+{
+    MidiParser parser;
+    MidiMessage messages[8];
+    // Program change and channel pressure only have one data byte.
+    const uint8_t bytes[]{0xC1, 5, 6, 0xD2, 100};
+    size_t count = Parse(parser, bytes, sizeof(bytes), messages);
+    CHECK(3 == count);
+    CHECK(Equals(messages[0], 0xC1, 5, 0));
+    CHECK(Equals(messages[1], 0xC1, 6, 0));
+    CHECK(Equals(messages[2], 0xD2, 100, 0));
+}
+
+MidiQueue queue;
+
+void TestQueue()
+{
+    MidiMessage message{};
+    CHECK(!queue.Pop(message));
+    for (size_t i = 0; i < kMidiQueueSize; i++)
+    {
+        CHECK(queue.Push({kMidiControlChange, static_cast<uint8_t>(i & 0x7F), 0}));
+    }
+    // The queue is full, the message is dropped and counted.
+    CHECK(!queue.Push({kMidiControlChange, 0, 0}));
+    CHECK(1 == queue.GetOverflows());
+    for (size_t i = 0; i < kMidiQueueSize; i++)
+    {
+        CHECK(queue.Pop(message));
+        CHECK(Equals(message, kMidiControlChange, i & 0x7F, 0));
+    }
+    CHECK(!queue.Pop(message));
+    // It keeps working after wrapping around.
+    CHECK(queue.Push({kMidiNoteOn, 1, 2}));
+    CHECK(queue.Pop(message));
+    CHECK(Equals(message, kMidiNoteOn, 1, 2));
+}
+
+void TestClock()
+{
+    // 120 BPM at 48KHz is 24000 samples per beat, 1000 samples per pulse,
+    // received in blocks of 48 samples.
+    const size_t blockSize = 48;
+    MidiClock clock;
+    clock.Reset();
+    CHECK(!clock.IsRunning());
+    size_t nextPulse{};
+    size_t beats{};
+    for (size_t time = 0; time < 24000 * 8; time += blockSize)
+    {
+        // The pulses are applied at the beginning of the block after them.
+        while (nextPulse < time)
+        {
+            if (clock.Tick())
+            {
+                beats++;
+            }
+            nextPulse += 1000;
+        }
+        clock.Advance(blockSize);
+    }
+    CHECK(clock.IsRunning());
+    CHECK(beats >= 6);
+    // The block jitter is averaged out over the beat.
+    CHECK(clock.GetSamplesPerBeat() > 24000.f - blockSize && clock.GetSamplesPerBeat() < 24000.f + blockSize);
+
+    // The clock is considered gone after 4 beats without pulses.
+    for (size_t time = 0; time < 24000 * 5; time += blockSize)
+    {
+        clock.Advance(blockSize);
+    }
+    CHECK(!clock.IsRunning());
+}
+
+// Each CC from 20 to 35 controls one parameter of one channel, the CCs that
+// act immediately are left to the caller.
+void TestMapping()
+{
+    MidiMapper mapper;
+    uint8_t channel{};
+    uint8_t idx{};
+    float value{};
+    for (uint8_t cc = kMidiFirstParameterCc; cc < kMidiFirstParameterCc + 16; cc++)
+    {
+        CHECK(mapper.Process({kMidiControlChange, cc, cc}));
+        CHECK(mapper.PopParameter(channel, idx, value));
+        CHECK((cc - kMidiFirstParameterCc) / 4 == channel);
+        CHECK((cc - kMidiFirstParameterCc) % 4 == idx);
+        CHECK(cc / 127.f == value);
+        CHECK(!mapper.PopParameter(channel, idx, value));
+    }
+    for (uint8_t cc = 0; cc < 3; cc++)
+    {
+        CHECK(mapper.Process({kMidiControlChange, static_cast<uint8_t>(kMidiFirstPitchShiftCc + cc), 127}));
+        CHECK(mapper.PopPitchShift(channel, value));
+        CHECK(cc == channel && 1.f == value);
+        CHECK(mapper.Process({kMidiControlChange, static_cast<uint8_t>(kMidiFirstSpectralFreezeCc + cc), 0}));
+        CHECK(mapper.PopSpectralFreeze(channel, value));
+        CHECK(cc == channel && 0.f == value);
+    }
+    for (uint8_t cc : {19, 42, 43, 44, 45})
+    {
+        CHECK(!mapper.Process({kMidiControlChange, cc, 64}));
+    }
+    CHECK(!mapper.PopParameter(channel, idx, value));
+    CHECK(!mapper.PopPitchShift(channel, value));
+    CHECK(!mapper.PopSpectralFreeze(channel, value));
+}
+
+// A burst of CCs within a block gives exactly one update per parameter at the
+// block boundary, with the latest value.
+void TestBatching()
+{
+    MidiMapper mapper;
+    MidiParser parser;
+    MidiMessage messages[512];
+    uint8_t bytes[1024];
+    size_t size{};
+    // A knob sweep on CC 20 (left Blend) and CC 35 (settings Size)
+    // interleaved, with running status, then the pitch shift of both
+    // channels moved twice.
+    bytes[size++] = 0xB0;
+    for (uint8_t v = 0; v < 128; v++)
+    {
+        bytes[size++] = 20;
+        bytes[size++] = v;
+        bytes[size++] = 35;
+        bytes[size++] = 127 - v;
+    }
+    for (uint8_t v : {10, 90})
+    {
+        bytes[size++] = 38;
+        bytes[size++] = v;
+    }
+    size_t count = Parse(parser, bytes, size, messages);
+    CHECK(258 == count);
+    for (size_t i = 0; i < count; i++)
+    {
+        CHECK(mapper.Process(messages[i]));
+    }
+
+    uint8_t channel{};
+    uint8_t idx{};
+    float value{};
+    CHECK(mapper.PopParameter(channel, idx, value));
+    CHECK(0 == channel && 0 == idx && 1.f == value);
+    CHECK(mapper.PopParameter(channel, idx, value));
+    CHECK(3 == channel && 3 == idx && 0.f == value);
+    CHECK(!mapper.PopParameter(channel, idx, value));
+    CHECK(mapper.PopPitchShift(channel, value));
+    CHECK(2 == channel && 90 / 127.f == value);
+    CHECK(!mapper.PopPitchShift(channel, value));
+    CHECK(!mapper.PopSpectralFreeze(channel, value));
+
+    // The changes received while they can't be applied are dropped.
+    mapper.Process({kMidiControlChange, 21, 5});
+    mapper.ClearParameters();
+    CHECK(!mapper.PopParameter(channel, idx, value));
+}
+
+// The notes trigger once per block, the clock messages go to the clock.
+void TestDispatch()
+{
+    MidiMapper mapper;
+    CHECK(!mapper.PopTrigger());
+    CHECK(mapper.Process({kMidiNoteOn | 2, 60, 100}));
+    CHECK(mapper.Process({kMidiNoteOn, 62, 100}));
+    CHECK(!mapper.Process({kMidiNoteOff, 60, 0}));
+    CHECK(mapper.PopTrigger());
+    CHECK(!mapper.PopTrigger());
+
+    // 120 BPM at 48KHz, one pulse every 1000 samples.
+    for (size_t i = 0; i < kMidiClockPpqn * 3; i++)
+    {
+        CHECK(mapper.Process({kMidiClock, 0, 0}));
+        mapper.GetClock().Advance(1000);
+    }
+    CHECK(mapper.GetClock().IsRunning());
+    CHECK(24000.f == mapper.GetClock().GetSamplesPerBeat());
+    CHECK(!mapper.Process({0xFC, 0, 0}));
+
+    // A Start restarts the count from the next pulse but keeps the tempo, so
+    // that the loop length doesn't change when the host starts.
+    mapper.GetClock().Advance(500);
+    CHECK(mapper.Process({kMidiStart, 0, 0}));
+    CHECK(mapper.GetClock().IsRunning());
+    CHECK(24000.f == mapper.GetClock().GetSamplesPerBeat());
+    for (size_t i = 0; i < kMidiClockPpqn; i++)
+    {
+        CHECK(!mapper.GetClock().Tick());
+        mapper.GetClock().Advance(1000);
+    }
+    CHECK(mapper.GetClock().Tick());
+    CHECK(24000.f == mapper.GetClock().GetSamplesPerBeat());
+
+    // A Start not followed by pulses still times out.
+    mapper.Process({kMidiStart, 0, 0});
+    mapper.GetClock().Advance(24000 * 5);
+    CHECK(!mapper.GetClock().IsRunning());
+}
+
+int main()
+{
+    TestRunningStatus();
+    TestInterleavedRealTime();
+    TestSysEx();
+    TestSingleDataByte();
+    TestQueue();
+    TestClock();
+    TestMapping();
+    TestBatching();
+    TestDispatch();
+
+    return TestResult();
+}
@@ -0,0 +1,249 @@
+#include "motion.h"
+#include "test.h"
+
+#include <cmath>
+#include <cstdint>
+
+using namespace wreath;
+
+MotionSequencer motion;
+
+struct Event
+{
+    uint32_t position;
+    uint8_t channel;
+    uint8_t idx;
+    float value;
+};
+
+constexpr size_t kMaxEvents{64};
+Event events[kMaxEvents];
+size_t eventCount{};
+
+// Plays the given number of samples like the audio callback does, and
+// collects the events replayed.
+void Run(uint32_t samples)
+{
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        Event event;
+        while (motion.PopDueEvent(event.channel, event.idx, event.value))
+        {
+            event.position = motion.GetPosition();
+            if (eventCount < kMaxEvents)
+            {
+                events[eventCount++] = event;
+            }
+        }
+        motion.Tick();
+    }
+}
+
+bool Equals(const Event &event, uint32_t position, uint8_t channel, uint8_t idx, float value)
+{
+    // The values are stored on 12 bits.
+    return event.position == position && event.channel == channel && event.idx == idx && std::fabs(event.value - value) < 1e-3f;
+}
+
+// A change recorded at a later position must not overwrite an older event of
+// the same parameter, even when another parameter was written in between.
+void TestMergeOnlyAtSamePosition()
+{
+    motion.Init();
+    motion.SetLength(200);
+    motion.StartRecording();
+    motion.Record(0, 0, 0.25f);
+    Run(100);
+    motion.Record(0, 1, 0.5f);
+    motion.Record(0, 0, 0.75f);
+    motion.StopRecording();
+    Run(100);
+    CHECK(3 == motion.GetEventCount());
+
+    eventCount = 0;
+    Run(200);
+    CHECK(3 == eventCount);
+    CHECK(Equals(events[0], 0, 0, 0, 0.25f));
+    CHECK(Equals(events[1], 100, 0, 1, 0.5f));
+    CHECK(Equals(events[2], 100, 0, 0, 0.75f));
+}
+
+// Only the latest value of a parameter is kept at a given position.
+void TestMergeAtSamePosition()
+{
+    motion.Init();
+    motion.SetLength(20);
+    Run(10);
+    motion.StartRecording();
+    motion.Record(1, 2, 0.1f);
+    motion.Record(2, 3, 0.3f);
+    motion.Record(1, 2, 0.2f);
+    motion.StopRecording();
+    Run(10);
+    CHECK(2 == motion.GetEventCount());
+
+    eventCount = 0;
+    Run(20);
+    CHECK(2 == eventCount);
+    CHECK(Equals(events[0], 10, 1, 2, 0.2f));
+    CHECK(Equals(events[1], 10, 2, 3, 0.3f));
+}
+
+// Nothing moves until the length of the loop is known.
+void TestIdle()
+{
+    motion.Init();
+    eventCount = 0;
+    Run(100000);
+    CHECK(0 == motion.GetPosition());
+    CHECK(0 == eventCount);
+}
+
+// Events further apart than the 16 bits delta are replayed at the exact
+// sample, and the loop wraps around.
+void TestLongDelta()
+{
+    motion.Init();
+    motion.SetLength(201000);
+    motion.StartRecording();
+    motion.Record(0, 0, 0.f);
+    Run(200000);
+    motion.Record(0, 0, 1.f);
+    motion.StopRecording();
+    Run(1000);
+
+    eventCount = 0;
+    Run(201000 * 2);
+    CHECK(4 == eventCount);
+    CHECK(Equals(events[0], 0, 0, 0, 0.f));
+    CHECK(Equals(events[1], 200000, 0, 0, 1.f));
+    CHECK(Equals(events[2], 0, 0, 0, 0.f));
+    CHECK(Equals(events[3], 200000, 0, 0, 1.f));
+}
+
+// An overdub pass replaces the events of the touched parameters from the
+// moment they're touched, and keeps everything else.
+void TestOverdub()
+{
+    motion.Init();
+    motion.SetLength(100);
+    motion.StartRecording();
+    motion.Record(0, 0, 0.25f);
+    motion.Record(0, 1, 0.5f);
+    Run(50);
+    motion.Record(0, 0, 0.75f);
+    motion.StopRecording();
+    Run(50);
+
+    // Touch the first parameter a quarter of the way through the second loop.
+    Run(25);
+    motion.StartRecording();
+    motion.Record(0, 0, 1.f);
+    motion.StopRecording();
+    Run(75);
+
+    eventCount = 0;
+    Run(100);
+    CHECK(3 == eventCount);
+    CHECK(Equals(events[0], 0, 0, 0, 0.25f));
+    CHECK(Equals(events[1], 0, 0, 1, 0.5f));
+    CHECK(Equals(events[2], 25, 0, 0, 1.f));
+}
+
+// A pass starting between two events far apart keeps the timing of both.
+void TestOverdubInLongDelta()
+{
+    motion.Init();
+    motion.SetLength(201000);
+    motion.StartRecording();
+    motion.Record(0, 0, 0.f);
+    Run(200000);
+    motion.Record(0, 0, 1.f);
+    motion.StopRecording();
+    Run(1000);
+
+    Run(100);
+    motion.StartRecording();
+    motion.Record(1, 0, 0.5f);
+    motion.StopRecording();
+    // Let the pass end.
+    Run(201000 - 100);
+
+    eventCount = 0;
+    Run(201000);
+    CHECK(3 == eventCount);
+    CHECK(Equals(events[0], 0, 0, 0, 0.f));
+    CHECK(Equals(events[1], 100, 1, 0, 0.5f));
+    CHECK(Equals(events[2], 200000, 0, 0, 1.f));
+}
+
+// Retriggering restarts the loop from the beginning, like the audio loop,
+// and ends the pass being written.
+void TestRetrigger()
+{
+    motion.Init();
+    motion.SetLength(100);
+    motion.StartRecording();
+    motion.Record(2, 0, 0.5f);
+    Run(40);
+    motion.Record(2, 1, 0.25f);
+    motion.StopRecording();
+    Run(20);
+    motion.Retrigger();
+    CHECK(0 == motion.GetPosition());
+
+    eventCount = 0;
+    Run(100);
+    CHECK(2 == eventCount);
+    CHECK(Equals(events[0], 0, 2, 0, 0.5f));
+    CHECK(Equals(events[1], 40, 2, 1, 0.25f));
+}
+
+// The loop follows the length of the audio loop: a shorter loop wraps right
+// away if it's already past the new end, and the events past it are skipped.
+void TestFollowLength()
+{
+    motion.Init();
+    motion.SetLength(100);
+    motion.StartRecording();
+    motion.Record(0, 0, 0.25f);
+    Run(50);
+    motion.Record(0, 0, 0.5f);
+    Run(40);
+    motion.Record(0, 0, 0.75f);
+    motion.StopRecording();
+    Run(10);
+
+    Run(95);
+    motion.SetLength(80);
+    CHECK(0 == motion.GetPosition());
+
+    eventCount = 0;
+    Run(160);
+    CHECK(4 == eventCount);
+    CHECK(Equals(events[0], 0, 0, 0, 0.25f));
+    CHECK(Equals(events[1], 50, 0, 0, 0.5f));
+    CHECK(Equals(events[2], 0, 0, 0, 0.25f));
+    CHECK(Equals(events[3], 50, 0, 0, 0.5f));
+
+    // Back to the original length, the last event plays again.
+    motion.SetLength(100);
+    eventCount = 0;
+    Run(100);
+    CHECK(3 == eventCount);
+    CHECK(Equals(events[2], 90, 0, 0, 0.75f));
+}
+
+int main()
+{
+    TestMergeOnlyAtSamePosition();
+    TestMergeAtSamePosition();
+    TestIdle();
+    TestLongDelta();
+    TestOverdub();
+    TestOverdubInLongDelta();
+    TestRetrigger();
+    TestFollowLength();
+
+    return TestResult();
+}
@@ -0,0 +1,221 @@
+#include "onset.h"
+#include "test.h"
+
+#include <cmath>
+#include <cstdint>
+
+using namespace wreath;
+
+constexpr float kSampleRate{48000.f};
+constexpr size_t kBlockSize{48};
+constexpr double kTwoPi{6.283185307179586};
+
+OnsetDetector onsetDetector;
+
+// A quiet noise floor with decaying 1KHz bursts at the given positions.
+struct Signal
+{
+    const size_t *onsets;
+    size_t onsetCount;
+    float amplitude;
+    uint32_t random{1};
+
+    float At(size_t time)
+    {
+        random = random * 1664525 + 1013904223;
+        float out = (static_cast<int32_t>(random) / 2147483648.f) * 0.001f;
+        for (size_t i = 0; i < onsetCount; i++)
+        {
+            if (time >= onsets[i])
+            {
+                double t = (time - onsets[i]) / kSampleRate;
+                out += static_cast<float>(amplitude * std::exp(-t / 0.01) * std::sin(kTwoPi * 1000.0 * t + 0.5));
+            }
+        }
+
+        return out;
+    }
+};
+
+constexpr size_t kMaxDetections{16};
+size_t detections[kMaxDetections];
+size_t detectionCount{};
+
+// Runs the detector like the audio callback does.
+void Run(Signal &signal, size_t start, size_t samples, float *delayed = nullptr)
+{
+    for (size_t time = start; time < start + samples; time += kBlockSize)
+    {
+        for (size_t i = 0; i < kBlockSize; i++)
+        {
+            float left = signal.At(time + i);
+            float right = left;
+            if (onsetDetector.Process(left, right) && detectionCount < kMaxDetections)
+            {
+                detections[detectionCount++] = time + i;
+            }
+            if (delayed)
+            {
+                delayed[time + i - start] = left;
+            }
+        }
+        onsetDetector.ProcessBlock();
+    }
+}
+
+// The onset is found at the first sample above the threshold, when the
+// detector is armed before each burst.
+void TestOnsetAccuracy()
+{
+    const size_t onsets[]{4800, 28800, 52848, 76801};
+    const float threshold = std::pow(10.f, -20.f / 20.f);
+    Signal signal{onsets, 4, 0.5f};
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetActive(true);
+    onsetDetector.SetThreshold(threshold);
+    detectionCount = 0;
+    for (size_t time = 0; time < 96000; time += 24000)
+    {
+        onsetDetector.Arm();
+        Run(signal, time, 24000);
+    }
+    CHECK(4 == detectionCount);
+
+    for (size_t i = 0; i < 4 && i < detectionCount; i++)
+    {
+        // The first sample of the burst above the threshold.
+        size_t expected = onsets[i];
+        while (0.5 * std::exp(-(expected - onsets[i]) / kSampleRate / 0.01) * std::fabs(std::sin(kTwoPi * 1000.0 * (expected - onsets[i]) / kSampleRate + 0.5)) <= threshold)
+        {
+            expected++;
+        }
+        CHECK(detections[i] == expected);
+    }
+}
+
+float output[96000];
+
+// The detection fires once, and only a new arming detects the next onset.
+// Arming during a sound waits for it to decay.
+void TestOneShot()
+{
+    const size_t onsets[]{4800, 28800, 52800, 76800};
+    Signal signal{onsets, 4, 0.5f};
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetActive(true);
+    onsetDetector.SetThreshold(0.1f);
+    detectionCount = 0;
+    Run(signal, 0, 52848);
+    CHECK(1 == detectionCount);
+    CHECK(!onsetDetector.IsArmed());
+    // Armed right after the third onset, while it's still loud.
+    onsetDetector.Arm();
+    Run(signal, 52848, 43152);
+    CHECK(2 == detectionCount);
+    CHECK(detectionCount < 2 || detections[1] >= 76800);
+}
+
+// Nothing is detected while inactive, and the input is not delayed.
+void TestInactive()
+{
+    const size_t onsets[]{4800};
+    Signal signal{onsets, 1, 0.5f};
+    Signal reference{onsets, 1, 0.5f};
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetThreshold(0.1f);
+    detectionCount = 0;
+    Run(signal, 0, 24000, output);
+    CHECK(0 == detectionCount);
+    for (size_t time = 0; time < 24000; time++)
+    {
+        CHECK(output[time] == reference.At(time));
+    }
+}
+
+// Nothing below the threshold triggers the detection.
+void TestBelowThreshold()
+{
+    const size_t onsets[]{4800, 28800};
+    Signal signal{onsets, 2, 0.05f};
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetActive(true);
+    onsetDetector.SetThreshold(0.1f);
+    detectionCount = 0;
+    Run(signal, 0, 48000);
+    CHECK(0 == detectionCount);
+}
+
+// While enabled the input is delayed of the pre-roll, so the onset is
+// kPreRollSamples samples later at the output.
+void TestPreRoll()
+{
+    const size_t onsets[]{24000};
+    Signal signal{onsets, 1, 0.5f};
+    Signal reference{onsets, 1, 0.5f};
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetActive(true);
+    onsetDetector.SetThreshold(0.1f);
+    Run(signal, 0, 48000, output);
+    for (size_t time = 0; time < 48000; time++)
+    {
+        float in = reference.At(time);
+        if (time + kPreRollSamples < 48000 && time > 2 * kPreRollSamples)
+        {
+            CHECK(output[time + kPreRollSamples] == in);
+        }
+    }
+}
+
+// Switching the detection on and off, from the threshold or the active
+// state, crossfades between the input and the delayed input, so a steady sine
+// has no jump at the output.
+void TestNoClick()
+{
+    onsetDetector.Init(kSampleRate, kBlockSize);
+    onsetDetector.SetActive(true);
+    // The sine moves of at most 2 * pi * 100 / 48000 per sample.
+    const double maxStep = kTwoPi * 100.0 / kSampleRate;
+    float previous{};
+    double largest{};
+    for (size_t block = 0; block < 2000; block++)
+    {
+        if (500 == block || 1500 == block || 1700 == block)
+        {
+            onsetDetector.SetThreshold(2.f);
+        }
+        else if (1000 == block || 1501 == block)
+        {
+            onsetDetector.SetThreshold(0.f);
+        }
+        else if (1800 == block)
+        {
+            onsetDetector.SetActive(false);
+        }
+        for (size_t i = 0; i < kBlockSize; i++)
+        {
+            float left = std::sin(kTwoPi * 100.0 * (block * kBlockSize + i) / kSampleRate);
+            float right = left;
+            onsetDetector.Process(left, right);
+            if (block > 0 || i > 0)
+            {
+                double step = std::fabs(left - previous);
+                largest = step > largest ? step : largest;
+            }
+            previous = left;
+        }
+        onsetDetector.ProcessBlock();
+    }
+    CHECK(largest < maxStep * 1.1);
+}
+
+int main()
+{
+    TestOnsetAccuracy();
+    TestOneShot();
+    TestInactive();
+    TestBelowThreshold();
+    TestPreRoll();
+    TestNoClick();
+
+    return TestResult();
+}
@@ -0,0 +1,41 @@
+#include "pitch_shifter.h"
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+
+using namespace wreath;
+
+constexpr size_t kSamples{48000 * 20};
+constexpr size_t kInputSamples{4096};
+
+PitchShifter pitchShifter;
+float input[kInputSamples];
+volatile float sink;
+
+// The cost per sample must not depend on the transposition, and must be
+// negligible when there is none.
+int main()
+{
+    for (size_t i = 0; i < kInputSamples; i++)
+    {
+        input[i] = std::sin(i * 0.01f);
+    }
+    pitchShifter.Init();
+    for (float semitones : {0.f, -24.f, -12.f, -1.f, 1.f, 7.f, 12.f, 24.f})
+    {
+        pitchShifter.SetPitch(semitones);
+        double ns = NsPerSample(kSamples, [](size_t samples) {
+            float sum{};
+            for (size_t i = 0; i < samples; i++)
+            {
+                sum += pitchShifter.Process(input[i & (kInputSamples - 1)]);
+            }
+            sink = sum;
+        });
+        std::printf("%+6.1f semitones: %6.2f ns/sample\n", semitones, ns);
+    }
+
+    return 0;
+}
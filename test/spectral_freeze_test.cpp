@@ -0,0 +1,133 @@
+#include "spectral_freeze.h"
+#include "test.h"
+
+#include <cmath>
+#include <initializer_list>
+
+using namespace wreath;
+
+constexpr float kSampleRate{48000.f};
+constexpr double kTwoPi{6.283185307179586};
+
+SpectralFreeze spectralFreeze;
+
+// Power of the signal at the given frequency, averaged over Hann windowed
+// segments (Goertzel), as the random phases change at every frame.
+double Power(const float *signal, size_t size, double frequency)
+{
+    double coeff = 2.0 * std::cos(kTwoPi * frequency / kSampleRate);
+    double power{};
+    size_t segments{};
+    for (size_t start = 0; start + kSpectralFrameSize <= size; start += kSpectralFrameSize)
+    {
+        double s1{};
+        double s2{};
+        for (size_t i = 0; i < kSpectralFrameSize; i++)
+        {
+            double window = 0.5 - 0.5 * std::cos(kTwoPi * i / kSpectralFrameSize);
+            double s = signal[start + i] * window + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s;
+        }
+        power += s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        segments++;
+    }
+
+    return power / segments;
+}
+
+struct Result
+{
+    double before;
+    double after;
+    double rms;
+};
+
+constexpr size_t kOutputSamples{48000};
+float output[kOutputSamples];
+
+// Freezes a sine, changes the input to a much louder sine at another
+// frequency right after, and measures the power of both in the frozen output.
+Result FreezeAndMeasure(size_t blockSize, double before, double after)
+{
+    spectralFreeze.Init(blockSize);
+    size_t time{};
+    auto process = [&](double frequency, double amplitude, bool record) {
+        spectralFreeze.Work();
+        for (size_t i = 0; i < blockSize; i++, time++)
+        {
+            float out = spectralFreeze.Process(static_cast<float>(amplitude * std::sin(kTwoPi * frequency * time / kSampleRate)));
+            if (record)
+            {
+                output[time % kOutputSamples] = out;
+            }
+        }
+    };
+
+    for (size_t i = 0; i < kSpectralFrameSize * 4 / blockSize; i++)
+    {
+        process(before, 1.0, false);
+    }
+    spectralFreeze.SetFreeze(1.f);
+    // Let the capture and the first frames go through.
+    for (size_t i = 0; i < kSpectralFrameSize * 8 / blockSize; i++)
+    {
+        process(after, 100.0, false);
+    }
+    time = 0;
+    size_t blocks = kOutputSamples / blockSize;
+    for (size_t i = 0; i < blocks; i++)
+    {
+        process(after, 100.0, true);
+    }
+
+    size_t size = blocks * blockSize;
+    double sum{};
+    for (size_t i = 0; i < size; i++)
+    {
+        sum += output[i] * output[i];
+    }
+
+    return {Power(output, size, before), Power(output, size, after), std::sqrt(sum / size)};
+}
+
+// Only what was playing when the freeze started must be captured, even if the
+// capture is spread over several blocks.
+void TestCapture()
+{
+    for (size_t blockSize : {1, 4, 48, 256})
+    {
+        Result result = FreezeAndMeasure(blockSize, 1000.0, 5000.0);
+        CHECK(result.after < result.before * 1e-6);
+        CHECK(0 == spectralFreeze.GetUnderruns());
+    }
+}
+
+// The resynthesis keeps the level of the captured signal (the sine has an
+// RMS of 1/sqrt(2)), within 1.5dB as the random phases make it fluctuate.
+void TestLevel()
+{
+    Result result = FreezeAndMeasure(48, 1000.0, 5000.0);
+    double db = 20.0 * std::log10(result.rms * std::sqrt(2.0));
+    CHECK(std::fabs(db) < 1.5);
+}
+
+// With no freeze the input goes through untouched.
+void TestPassthrough()
+{
+    spectralFreeze.Init(48);
+    for (size_t i = 0; i < 1000; i++)
+    {
+        float in = std::sin(i * 0.37f);
+        CHECK(spectralFreeze.Process(in) == in);
+    }
+}
+
+int main()
+{
+    TestCapture();
+    TestLevel();
+    TestPassthrough();
+
+    return TestResult();
+}
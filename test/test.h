@@ -0,0 +1,36 @@
+#pragma once
+
+/**
+ * Minimal test helpers for the host tests: CHECK reports the failed condition
+ * and keeps going, TestResult gives the exit code of the test.
+ */
+
+#include <cstdio>
+
+namespace wreath
+{
+    int testFailures{};
+
+    inline int TestResult()
+    {
+        if (testFailures > 0)
+        {
+            std::printf("%d check(s) failed\n", testFailures);
+
+            return 1;
+        }
+        std::printf("ok\n");
+
+        return 0;
+    }
+}
+
+#define CHECK(condition)                                                           \
+    do                                                                             \
+    {                                                                              \
+        if (!(condition))                                                          \
+        {                                                                          \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            wreath::testFailures++;                                                \
+        }                                                                          \
+    } while (0)
@@ -2,6 +2,8 @@
 
 #include "hw.h"
 #include "repetita.h"
+#include "motion.h"
+#include "onset.h"
 #include "wreath/head.h"
 #include "Utility/dsp.h"
 #include <string>
@@ -16,6 +18,8 @@ namespace wreath
     constexpr float kMaxGain{5.f};
     constexpr float kMaxFilterValue{1500.f};
     constexpr float kMaxRateSlew{10.f};
+    // Lowest recording threshold set from MIDI, in dB.
+    constexpr float kMinOnsetThresholdDb{-48.f};
 
     enum Channel
     {
@@ -52,6 +56,12 @@ namespace wreath
     bool recordingLeftTriggered{};
     bool recordingRightTriggered{};
 
+    MotionSequencer motion;
+    OnsetDetector onsetDetector;
+
+    MidiMapper midiMapper;
+    float midiQuantizedSamplesPerBeat{};
+
     bool startUp{true};
     bool first{true};
     bool buffering{};
@@ -133,12 +143,15 @@ namespace wreath
         }
 
         currentTriggerMode = static_cast<TriggerMode>(value);
+        // The threshold recording and its pre-roll are only for REC mode.
+        onsetDetector.SetActive(TriggerMode::REC == currentTriggerMode);
 
         switch (currentTriggerMode)
         {
         case TriggerMode::REC:
             looper.mustStopWriting = true;
             looper.SetLooping(true);
+            onsetDetector.Arm();
             break;
         case TriggerMode::LOOP:
             recordingLeftTriggered = false;
@@ -191,6 +204,113 @@ namespace wreath
         }
     }
 
+    // In REC mode with a threshold set, a trigger arms the detection (or
+    // disarms it) instead of starting the recording, which then starts at the
+    // next onset. A trigger always stops a recording.
+    void HandleRecTrigger()
+    {
+        if (onsetDetector.IsEnabled() && !recordingLeftTriggered && !recordingRightTriggered)
+        {
+            if (onsetDetector.IsArmed())
+            {
+                onsetDetector.Disarm();
+            }
+            else
+            {
+                onsetDetector.Arm();
+            }
+
+            return;
+        }
+        HandleTriggerRecording();
+    }
+
+    // Handles a trigger from the gate input or a MIDI note.
+    void HandleTrigger()
+    {
+        if (recordingArmed)
+        {
+            SettingsMode(false);
+            looper.mustResetLooper = true;
+            recordingArmed = false;
+        }
+        else if (TriggerMode::REC == currentTriggerMode)
+        {
+            HandleRecTrigger();
+        }
+        else
+        {
+            if (TriggerMode::ONESHOT == currentTriggerMode)
+            {
+                looper.mustRestart = true;
+            }
+            else
+            {
+                looper.mustRetrigger = true;
+            }
+            motion.Retrigger();
+        }
+    }
+
+    // Rounds the loop length to a whole number of beats when following a
+    // MIDI clock.
+    float QuantizeLoopLength(Channel channel, float length)
+    {
+        if (!midiMapper.GetClock().IsRunning())
+        {
+            return length;
+        }
+
+        float samplesPerBeat = midiMapper.GetClock().GetSamplesPerBeat();
+        float maxBeats = std::floor(looper.GetBufferSamples(channel) / samplesPerBeat);
+        if (maxBeats < 1.f)
+        {
+            return length;
+        }
+
+        return fclamp(std::round(length / samplesPerBeat), 1.f, maxBeats) * samplesPerBeat;
+    }
+
+    // Sets the loop length of a channel. The motion loop follows the loop of
+    // the left channel, which is also the one of both channels unless Size
+    // is set per channel.
+    void SetLoopLength(Channel channel, float length)
+    {
+        looper.SetLoopLength(channel, length);
+        if (Channel::LEFT == channel)
+        {
+            motion.SetLength(static_cast<uint32_t>(length));
+        }
+    }
+
+    // Transposes the wet signal without affecting the loop timing.
+    void SetPitchShift(Channel channel, float semitones)
+    {
+        if (Channel::BOTH == channel || Channel::LEFT == channel)
+        {
+            pitchShifters[Channel::LEFT].SetPitch(semitones);
+        }
+        if (Channel::BOTH == channel || Channel::RIGHT == channel)
+        {
+            pitchShifters[Channel::RIGHT].SetPitch(semitones);
+        }
+        UpdateDryWetMix();
+    }
+
+    // Mixes in the resynthesised spectrum captured when the amount leaves 0.
+    void SetSpectralFreeze(Channel channel, float amount)
+    {
+        if (Channel::BOTH == channel || Channel::LEFT == channel)
+        {
+            spectralFreezes[Channel::LEFT].SetFreeze(amount);
+        }
+        if (Channel::BOTH == channel || Channel::RIGHT == channel)
+        {
+            spectralFreezes[Channel::RIGHT].SetFreeze(amount);
+        }
+        UpdateDryWetMix();
+    }
+
     inline void ProcessParameter(short idx, float value, Channel channel)
     {
         // Keep track of parameters values only after startup.
@@ -226,7 +346,8 @@ namespace wreath
             }
             else
             {
-                looper.dryWetMix = value;
+                dryWetMix = value;
+                UpdateDryWetMix();
             }
             break;
         // Start
@@ -296,31 +417,31 @@ namespace wreath
                     // Backwards, from buffer's length to 50ms.
                     if (v <= 0.35f)
                     {
-                        looper.SetLoopLength(Channel::LEFT, Map(v, 0.f, 0.35f, looper.GetBufferSamples(Channel::LEFT), kMinSamplesForFlanger));
+                        SetLoopLength(Channel::LEFT, QuantizeLoopLength(Channel::LEFT, Map(v, 0.f, 0.35f, looper.GetBufferSamples(Channel::LEFT), kMinSamplesForFlanger)));
                         looper.SetDirection(Channel::LEFT, Direction::BACKWARDS);
                     }
                     // Backwards, from 50ms to 1ms (grains).
                     else if (v < 0.47f)
                     {
-                        looper.SetLoopLength(Channel::LEFT, Map(v, 0.35f, 0.47f, kMinSamplesForFlanger, kMinSamplesForTone));
+                        SetLoopLength(Channel::LEFT, Map(v, 0.35f, 0.47f, kMinSamplesForFlanger, kMinSamplesForTone));
                         looper.SetDirection(Channel::LEFT, Direction::BACKWARDS);
                     }
                     // Forward, from 1ms to 50ms (grains).
                     else if (v >= 0.53f && v < 0.65f)
                     {
-                        looper.SetLoopLength(Channel::LEFT, Map(v, 0.53f, 0.65f, kMinSamplesForTone, kMinSamplesForFlanger));
+                        SetLoopLength(Channel::LEFT, Map(v, 0.53f, 0.65f, kMinSamplesForTone, kMinSamplesForFlanger));
                         looper.SetDirection(Channel::LEFT, Direction::FORWARD);
                     }
                     // Forward, from 50ms to buffer's length.
                     else if (v >= 0.65f)
                     {
-                        looper.SetLoopLength(Channel::LEFT, Map(v, 0.65f, 1.f, kMinSamplesForFlanger, looper.GetBufferSamples(Channel::LEFT)));
+                        SetLoopLength(Channel::LEFT, QuantizeLoopLength(Channel::LEFT, Map(v, 0.65f, 1.f, kMinSamplesForFlanger, looper.GetBufferSamples(Channel::LEFT))));
                         looper.SetDirection(Channel::LEFT, Direction::FORWARD);
                     }
                     // Center dead zone.
                     else
                     {
-                        looper.SetLoopLength(Channel::LEFT, Map(v, 0.47f, 0.53f, kMinLoopLengthSamples, kMinLoopLengthSamples));
+                        SetLoopLength(Channel::LEFT, Map(v, 0.47f, 0.53f, kMinLoopLengthSamples, kMinLoopLengthSamples));
                         looper.SetDirection(Channel::LEFT, Direction::FORWARD);
                     }
 
@@ -340,31 +461,31 @@ namespace wreath
                     // Backwards, from buffer's length to 50ms.
                     if (v <= 0.35f)
                     {
-                        looper.SetLoopLength(Channel::RIGHT, Map(v, 0.f, 0.35f, looper.GetBufferSamples(Channel::RIGHT), kMinSamplesForFlanger));
+                        SetLoopLength(Channel::RIGHT, QuantizeLoopLength(Channel::RIGHT, Map(v, 0.f, 0.35f, looper.GetBufferSamples(Channel::RIGHT), kMinSamplesForFlanger)));
                         looper.SetDirection(Channel::RIGHT, Direction::BACKWARDS);
                     }
                     // Backwards, from 50ms to 1ms (grains).
                     else if (v < 0.47f)
                     {
-                        looper.SetLoopLength(Channel::RIGHT, Map(v, 0.35f, 0.47f, kMinSamplesForFlanger, kMinSamplesForTone));
+                        SetLoopLength(Channel::RIGHT, Map(v, 0.35f, 0.47f, kMinSamplesForFlanger, kMinSamplesForTone));
                         looper.SetDirection(Channel::RIGHT, Direction::BACKWARDS);
                     }
                     // Forward, from 1ms to 50ms (grains).
                     else if (v >= 0.53f && v < 0.65f)
                     {
-                        looper.SetLoopLength(Channel::RIGHT, Map(v, 0.53f, 0.65f, kMinSamplesForTone, kMinSamplesForFlanger));
+                        SetLoopLength(Channel::RIGHT, Map(v, 0.53f, 0.65f, kMinSamplesForTone, kMinSamplesForFlanger));
                         looper.SetDirection(Channel::RIGHT, Direction::FORWARD);
                     }
                     // Forward, from 50ms to buffer's length.
                     else if (v >= 0.65f)
                     {
-                        looper.SetLoopLength(Channel::RIGHT, Map(v, 0.65f, 1.f, kMinSamplesForFlanger, looper.GetBufferSamples(Channel::RIGHT)));
+                        SetLoopLength(Channel::RIGHT, QuantizeLoopLength(Channel::RIGHT, Map(v, 0.65f, 1.f, kMinSamplesForFlanger, looper.GetBufferSamples(Channel::RIGHT))));
                         looper.SetDirection(Channel::RIGHT, Direction::FORWARD);
                     }
                     // Center dead zone.
                     else
                     {
-                        looper.SetLoopLength(Channel::RIGHT, Map(v, 0.47f, 0.53f, kMinLoopLengthSamples, kMinLoopLengthSamples));
+                        SetLoopLength(Channel::RIGHT, Map(v, 0.47f, 0.53f, kMinLoopLengthSamples, kMinLoopLengthSamples));
                         looper.SetDirection(Channel::RIGHT, Direction::FORWARD);
                     }
 
@@ -522,11 +643,133 @@ namespace wreath
         if (std::abs(knobValues[idx] - value) > kMinValueDelta)
         {
             ProcessParameter(idx, value, currentChannel);
+            motion.Record(currentChannel, idx, value);
 
             knobValues[idx] = value;
         }
     }
 
+    // Handles the CCs that act immediately, the others are batched by the
+    // mapper.
+    inline void ProcessMidiMessage(const MidiMessage &message)
+    {
+        if (midiMapper.Process(message) || kMidiControlChange != message.Type())
+        {
+            return;
+        }
+        if (kMidiMotionRecordCc == message.data1)
+        {
+            if (message.data2 >= 64)
+            {
+                motion.StartRecording();
+            }
+            else
+            {
+                motion.StopRecording();
+            }
+        }
+        else if (kMidiMotionClearCc == message.data1 && message.data2 >= 64)
+        {
+            motion.Clear();
+        }
+        else if (kMidiOnsetThresholdCc == message.data1)
+        {
+            onsetDetector.SetThreshold(message.data2 > 0 ? std::pow(10.f, Map(message.data2, 1.f, 127.f, kMinOnsetThresholdDb, 0.f) / 20.f) : 0.f);
+        }
+    }
+
+    // Applies the MIDI messages received since the previous block. Only the
+    // latest value of each parameter is applied, so a burst of CCs costs the
+    // same as a single one.
+    inline void ProcessMidi(size_t size)
+    {
+        MidiMessage message;
+        while (midiQueue.Pop(message))
+        {
+            ProcessMidiMessage(message);
+        }
+        midiMapper.GetClock().Advance(size);
+
+        bool triggered = midiMapper.PopTrigger();
+
+        if (looper.IsStartingUp() || looper.IsBuffering() || looper.IsReady())
+        {
+            // A note stops the buffering, like the button and the gate.
+            if (triggered && looper.IsBuffering())
+            {
+                looper.mustStopBuffering = true;
+            }
+            midiMapper.ClearParameters();
+
+            return;
+        }
+
+        uint8_t channel;
+        uint8_t idx;
+        float value;
+        while (midiMapper.PopParameter(channel, idx, value))
+        {
+            ProcessParameter(idx, value, static_cast<Channel>(channel));
+            motion.Record(channel, idx, value);
+        }
+        while (midiMapper.PopPitchShift(channel, value))
+        {
+            SetPitchShift(static_cast<Channel>(channel), std::round(Map(value, 0.f, 1.f, kMinPitchShift, kMaxPitchShift)));
+        }
+        while (midiMapper.PopSpectralFreeze(channel, value))
+        {
+            SetSpectralFreeze(static_cast<Channel>(channel), value);
+        }
+
+        // Re-quantize the loop length when the tempo changes.
+        float samplesPerBeat = midiMapper.GetClock().GetSamplesPerBeat();
+        if (std::abs(samplesPerBeat - midiQuantizedSamplesPerBeat) > samplesPerBeat * 0.01f)
+        {
+            midiQuantizedSamplesPerBeat = samplesPerBeat;
+            ProcessParameter(CV_4, channelValues[Channel::BOTH][CV_4], Channel::BOTH);
+        }
+
+        if (triggered && Channel::SETTINGS != currentChannel && ButtonHoldMode::NO_MODE == buttonHoldMode)
+        {
+            HandleTrigger();
+        }
+    }
+
+    // Replays the recorded movements due at the current sample, then moves to
+    // the next one. Called for every sample.
+    inline void ProcessMotion()
+    {
+        uint8_t channel;
+        uint8_t idx;
+        float value;
+        while (motion.PopDueEvent(channel, idx, value))
+        {
+            ProcessParameter(idx, value, static_cast<Channel>(channel));
+        }
+        motion.Tick();
+    }
+
+    // In REC mode, starts the recording at the exact sample the input crosses
+    // the threshold after the detection has been armed. The input is delayed
+    // by the pre-roll, so the recording also gets the kPreRollSamples samples
+    // that preceded the onset.
+    inline void ProcessOnset(float &left, float &right)
+    {
+        if (!onsetDetector.Process(left, right))
+        {
+            return;
+        }
+        if (TriggerMode::REC != currentTriggerMode || recordingLeftTriggered || recordingRightTriggered || Channel::SETTINGS == currentChannel)
+        {
+            return;
+        }
+        if (looper.IsStartingUp() || looper.IsBuffering() || looper.IsReady())
+        {
+            return;
+        }
+        HandleTriggerRecording();
+    }
+
     inline void ProcessUi()
     {
         if (looper.IsStartingUp())
@@ -602,6 +845,7 @@ namespace wreath
             }
 
             looper.Start();
+            motion.Retrigger();
 
             return;
         }
@@ -659,14 +903,16 @@ namespace wreath
                         if (TriggerMode::ONESHOT == currentTriggerMode)
                         {
                             looper.mustRestart = true;
+                            motion.Retrigger();
                         }
                         else if (TriggerMode::REC == currentTriggerMode)
                         {
-                            HandleTriggerRecording();
+                            HandleRecTrigger();
                         }
                         else
                         {
                             looper.mustRetrigger = true;
+                            motion.Retrigger();
                         }
                     }
                 }
@@ -705,27 +951,7 @@ namespace wreath
         {
             if (hw.gate_in_1.Trig())
             {
-                if (recordingArmed)
-                {
-                    SettingsMode(false);
-                    looper.mustResetLooper = true;
-                    recordingArmed = false;
-                }
-                else if (TriggerMode::REC == currentTriggerMode)
-                {
-                    HandleTriggerRecording();
-                }
-                else
-                {
-                    if (TriggerMode::ONESHOT == currentTriggerMode)
-                    {
-                        looper.mustRestart = true;
-                    }
-                    else
-                    {
-                        looper.mustRetrigger = true;
-                    }
-                }
+                HandleTrigger();
             }
         }
 